@@ -1,9 +1,21 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <limits.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "SDL.h"
 #include "SDL_ttf.h"
 
@@ -12,89 +24,695 @@ const int INITIAL_SCREEN_HEIGHT = 480;
 
 const int POINT_SIZE = 10;
 
+const char FONT_PATH[] = "fonts/m5x7.ttf";
+const int FONT_SIZE = 16; // ptsize = 16, 32, 48, etc.
+
 const float SLIDER_MAX = 2.00f;
 const float SLIDER_MIN = 0.01f;
 
+// maximum distance in pixels between the drawn curve and the actual curve
+const float CURVE_TOLERANCE = 0.25f;
+#define MAX_CURVE_SEGMENTS 1024
+
+// how far in pixels from a curve a click still picks it
+const float CURVE_PICK_DISTANCE = 4.0f;
+
 typedef struct {
     float x;
     float y;
 } Vec2;
 
+typedef struct {
+    Vec2 min;
+    Vec2 max;
+} BoundingBox;
+
+/* Which evaluator a curve's weights let us use. Equal weights cancel out, leaving
+   a plain polynomial cubic, and weights that mirror each other (r0 = r3, r1 = r2,
+   as in a conic raised to a cubic) need half the weight multiplies. */
+typedef enum {
+    WEIGHTS_POLYNOMIAL,
+    WEIGHTS_SYMMETRIC,
+    WEIGHTS_GENERAL,
+} WeightPattern;
+
+// curves are grouped into chunks of this many, so that whole chunks can be culled at once
+#define CURVE_CHUNK_SIZE 1024
+
+// edits a document remembers, so that copies a few versions behind can catch up curve by curve
+#define CURVE_EDIT_LOG_SIZE 16
+
+// the curve changed to bring a document to a version
+typedef struct {
+    int version;
+    int curve;
+} CurveEdit;
+
+/* A document of rational cubic curves. Each per-curve field lives in its own array
+   with 4 consecutive entries per curve, so a curve's control points and weights can
+   be passed straight to the evaluators.
+
+   The arrays can also be borrowed from a mapped scene file (or another document
+   borrowing them), in which case they are read only: the first change copies them
+   into arrays of the document's own. */
+typedef struct {
+    int count;
+    int capacity;
+    /* incremented on every change, so copies can tell when they are out of date */
+    int version;
+    Vec2 * points;
+    float * weights;
+    /* one per curve, kept up to date by the functions that modify curves */
+    BoundingBox * bounds;
+    /* one per chunk of curves, bounding all their control points */
+    BoundingBox * chunk_bounds;
+    /* the edit that made each of the last few versions, at edits[version % CURVE_EDIT_LOG_SIZE] */
+    CurveEdit edits[CURVE_EDIT_LOG_SIZE];
+    /* whether the arrays belong to something else */
+    bool borrowed;
+    /* scene file mapped by this document, unmapped on cleanup */
+    const void * mapping;
+    size_t mapping_size;
+} CurveDocument;
+
+// highest degree of NURBS curve that can be evaluated or converted
+#define NURBS_MAX_DEGREE 15
+
+/* A non-uniform rational B-spline of count control points (each with a weight) and
+   count + degree + 1 non-decreasing knots, defined for t from knots[degree] to
+   knots[count]. The knots don't have to be clamped. */
+typedef struct {
+    int degree;
+    int count;
+    const Vec2 * points;
+    const float * weights;
+    const double * knots;
+} NurbsCurve;
+
+// a point on a curve, found by one of the curve queries
+typedef struct {
+    double t;
+    Vec2 point;
+    /* from the query point, or along the ray for ray queries */
+    float distance;
+} CurvePoint;
+
+// a point where two curves cross, at t_a along the first and t_b along the second
+typedef struct {
+    int curve_a;
+    int curve_b;
+    double t_a;
+    double t_b;
+    Vec2 point;
+} CurveIntersection;
+
+/* Uniform grid over all the control points of a document, used for picking. Point
+   indices are stored sorted by cell, cell c owning entries[cell_start[c]] up to
+   entries[cell_start[c + 1]] */
+typedef struct {
+    Vec2 origin;
+    float cell_size;
+    int columns;
+    int rows;
+    int * cell_start;
+    int * entries;
+    /* set when points have moved since the grid was built */
+    bool stale;
+} PointGrid;
+
 typedef enum {
     MOUSE_SELECTED_NONE,
     MOUSE_SELECTED_POINT,
     MOUSE_SELECTED_SLIDER,
+    MOUSE_SELECTED_CURVE,
     MOUSE_SELECTED_BACKGROUND,
 } MouseSelectionState;
 
-// TODO max/min viewport scaling? Checks that we aren't dividing by 0 at any point?
+// every character that can appear in a slider label (or the profile overlay)
+const char ATLAS_CHARS[] = "0123456789. abcdefghijklmnopqrstuvwxyz";
+#define ATLAS_CHAR_COUNT (sizeof(ATLAS_CHARS) - 1)
+
+// most glyphs drawn from the atlas in one call
+#define MAX_TEXT_QUADS 64
+
+/* All the label characters rendered once into a single texture, so labels can be
+   drawn as textured quads without creating any surfaces or textures per frame */
+typedef struct {
+    SDL_Texture * texture;
+    /* RGBA32 copy of the texture contents, for the software renderer */
+    SDL_Surface * surface;
+    int width;
+    int height;
+    /* character i covers columns glyph_x[i] to glyph_x[i + 1] */
+    int glyph_x[ATLAS_CHAR_COUNT + 1];
+} GlyphAtlas;
+
+// parts of the render state changed since the last frame was drawn
+typedef enum {
+    DIRTY_POINTS = 1 << 0,
+    DIRTY_SLIDERS = 1 << 1,
+    DIRTY_VIEWPORT = 1 << 2,
+    DIRTY_WINDOW = 1 << 3,
+    DIRTY_ALL = DIRTY_POINTS | DIRTY_SLIDERS | DIRTY_VIEWPORT | DIRTY_WINDOW,
+} DirtyFlags;
+
+typedef enum {
+    SOFTWARE_CLEAR,
+    SOFTWARE_POLYLINE,
+    SOFTWARE_RECTS,
+    SOFTWARE_ATLAS_RECTS,
+    SOFTWARE_FILL,
+} SoftwareCommandType;
+
+/* A recorded draw call. Polylines use vertices[first] onwards, fill rects use
+   rects[first] onwards, atlas draws use pairs of source and destination rects
+   starting at rects[first] and filled paths are fills[first] */
+typedef struct {
+    SoftwareCommandType type;
+    SDL_Color color;
+    int first;
+    int count;
+} SoftwareCommand;
+
+// which points are inside a filled path, going by how many times the path winds around them
+typedef enum {
+    FILL_NONZERO,
+    FILL_EVEN_ODD,
+} FillRule;
+
+// a straight edge of a filled path in pixel coordinates, with y0 < y1
+typedef struct {
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+    /* 1 if the path goes down the edge, -1 if it goes up */
+    float direction;
+} FillEdge;
+
+/* A filled path, polygon i being fill_points[fill_starts[first_start + i]] up to
+   fill_points[fill_starts[first_start + i + 1]] for i below count. Its edges are clipped
+   and binned into the bands of rows they cross by the raster threads, a chunk at a time
+   (chunks first_chunk up to first_chunk + chunk_count), after which band b's edges are
+   fill_band_edges[k] for k from fill_band_starts[first_band + b] up to
+   fill_band_starts[first_band + b + 1] */
 typedef struct {
-    /* bezier points */
+    FillRule rule;
+    int first_start;
+    int count;
+    int first_chunk;
+    int chunk_count;
+    int first_band;
+} SoftwareFill;
+
+// edges of a filled path that a raster thread clips and bins at a time
+#define FILL_CHUNK_EDGES 4096
+
+/* floats after the last pixel of each row of coverage being accumulated, so the
+   accumulate kernel can add to the few pixels after any pixel up to the width */
+#define FILL_ROW_PADDING 16
+
+/* The edges from fill_points[first_point] up to fill_points[end_point] of fill, polygon
+   being the index in fill_starts of the polygon first_point is in. As clipping splits an
+   edge into at most 3, the chunk's clipped edges go to fill_edges[3 * first_point] on. */
+typedef struct {
+    int fill;
+    int polygon;
+    int first_point;
+    int end_point;
+    /* how many clipped edges the chunk has, once it's been clipped */
+    int edge_count;
+} SoftwareFillChunk;
+
+// rows in each band the software renderer rasterizes (and each thread takes) at a time
+#define SOFTWARE_BAND_HEIGHT 32
+
+// most threads used by the tessellation pool (and the software renderer)
+#define MAX_WORKER_THREADS 16
+
+// runs on each worker of a WorkerThreads_run, worker 0 being the thread that called it
+typedef void (*WorkerFunction)(void * data, int worker);
+
+struct WorkerThreads;
+
+typedef struct {
+    struct WorkerThreads * owner;
+    int worker;
+    /* the last run this thread has seen */
+    int generation;
+} WorkerThread;
+
+/* Threads that are started once and then wait between runs, so spreading a frame's
+   work across cores doesn't pay for starting threads every frame. Threads are only
+   started by the first run that wants them, and the struct must stay put after that. */
+typedef struct WorkerThreads {
+    SDL_mutex * mutex;
+    /* signalled when a run starts, or when the threads should exit */
+    SDL_cond * start;
+    /* signalled when the last thread finishes its part of a run */
+    SDL_cond * done;
+    SDL_Thread * threads[MAX_WORKER_THREADS];
+    WorkerThread thread_data[MAX_WORKER_THREADS];
+    int thread_count;
+    /* the current run, with worker_count including the calling thread */
+    WorkerFunction function;
+    void * data;
+    int worker_count;
+    int generation;
+    int finished;
+    bool exiting;
+} WorkerThreads;
+
+/* CPU rasterizer drawing into an RGBA framebuffer in memory, so that frames can be
+   rendered without a display. Draw calls are recorded into a display list, then
+   rasterized in horizontal bands spread across threads when the frame is presented. */
+typedef struct {
+    int width;
+    int height;
+    /* 4 bytes per pixel, in R, G, B, A order */
+    Uint8 * pixels;
+    int thread_count;
+    WorkerThreads workers;
+    SDL_Color color;
+    /* glyphs for SOFTWARE_ATLAS_RECTS, RGBA32 */
+    SDL_Surface * atlas;
+    /* display list for the current frame */
+    SoftwareCommand * commands;
+    int command_count;
+    int commands_capacity;
+    Vec2 * vertices;
+    int vertex_count;
+    int vertices_capacity;
+    SDL_Rect * rects;
+    int rect_count;
+    int rects_capacity;
+    SoftwareFill * fills;
+    int fill_count;
+    int fills_capacity;
+    Vec2 * fill_points;
+    int fill_point_count;
+    int fill_points_capacity;
+    int * fill_starts;
+    int fill_start_count;
+    int fill_starts_capacity;
+    SoftwareFillChunk * fill_chunks;
+    int fill_chunk_count;
+    int fill_chunks_capacity;
+    /* how many of each chunk's edges cross each band, then where the chunk's next edge in
+       each band goes in fill_band_edges */
+    int * fill_chunk_bands;
+    int fill_chunk_bands_capacity;
+    FillEdge * fill_edges;
+    int fill_edges_capacity;
+    /* copies of the clipped edges, grouped by band so rasterizing a band reads its
+       edges one after another */
+    FillEdge * fill_band_edges;
+    int fill_band_edges_capacity;
+    int * fill_band_starts;
+    int fill_band_start_count;
+    int fill_band_starts_capacity;
+    /* rows of coverage accumulated while filling a band for each of accumulation_threads
+       threads, kept zeroed between uses */
+    float * accumulation;
+    int accumulation_threads;
+} SoftwareRenderer;
+
+/* Bump allocator for buffers that only live until the end of a frame. Anything that
+   doesn't fit in the block gets its own heap allocation, and the block is grown at the
+   next reset to fit the whole of that frame, so once frames stop getting bigger there
+   are no allocations at all. */
+typedef struct {
+    char * memory;
+    size_t capacity;
+    size_t used;
+    /* bytes handed out since the last reset, including overflow */
+    size_t requested;
+    /* heap allocations that didn't fit in the block, chained through their first bytes */
+    void * overflow;
+} FrameArena;
+
+/* Profiling, compiled in with -DBEZIER_PROFILE (the default make target, but not
+   release or bench). Stages are timed with PROFILE_BEGIN and PROFILE_END on the main
+   thread, which handles events, and the render thread, which draws frames. Each
+   frame's totals go into a ring of recent frames for the overlay and each timed scope
+   into a ring of trace events for --trace. */
+#ifdef BEZIER_PROFILE
+
+typedef enum {
+    PROFILE_STAGE_FRAME,
+    PROFILE_STAGE_CULL,
+    PROFILE_STAGE_TESSELLATE,
+    PROFILE_STAGE_TRANSFORM,
+    PROFILE_STAGE_DRAW,
+    PROFILE_STAGE_TEXT,
+    PROFILE_STAGE_OVERLAY,
+    PROFILE_STAGE_PRESENT,
+    PROFILE_STAGE_EVENTS,
+    PROFILE_STAGE_MUTEX_WAIT,
+    PROFILE_STAGE_PUBLISH,
+    PROFILE_STAGE_COUNT,
+} ProfileStage;
+
+const char * const PROFILE_STAGE_NAMES[PROFILE_STAGE_COUNT] = {
+    "frame", "cull", "tessellate", "transform", "draw", "text", "overlay", "present",
+    "events", "mutex wait", "publish",
+};
+
+// frames kept for the overlay, and timed scopes kept for the trace
+#define PROFILE_FRAMES 256
+#define PROFILE_TRACE_EVENTS 16384
+
+// time spent in each stage during a frame, including the events handled before it
+typedef struct {
+    double stage_seconds[PROFILE_STAGE_COUNT];
+    int draw_calls;
+} FrameProfile;
+
+typedef struct {
+    int stage;
+    SDL_threadID thread;
+    double start;
+    double duration;
+} TraceEvent;
+
+typedef struct {
+    /* the frame being recorded, and the last PROFILE_FRAMES frames at frames[n % PROFILE_FRAMES] */
+    FrameProfile current;
+    FrameProfile frames[PROFILE_FRAMES];
+    int frame_count;
+    /* likewise the last PROFILE_TRACE_EVENTS scopes */
+    TraceEvent events[PROFILE_TRACE_EVENTS];
+    int event_count;
+    /* held while recording, so both threads can time their stages */
+    SDL_SpinLock lock;
+    /* toggled by the main thread, read by the render thread */
+    SDL_atomic_t overlay_visible;
+} Profiler;
+
+#define PROFILE_BEGIN(stage) const double profile_start_##stage = get_seconds()
+#define PROFILE_END(stage) Profiler_record(&profiler, stage, profile_start_##stage)
+#define PROFILE_COUNT_DRAW_CALL() (profiler.current.draw_calls++)
+
+#else
+
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#define PROFILE_COUNT_DRAW_CALL()
+
+#endif
+
+/* Precision curves are tessellated in: the double precision forward differencing
+   is the reference, and the float path evaluates the curve directly, twice as many
+   points per SIMD instruction. --precision-report measures how far apart they are. */
+typedef enum {
+    BEZIER_PRECISION_DOUBLE,
+    BEZIER_PRECISION_FLOAT,
+} BezierPrecision;
+
+// a span of one curve's segments, tessellated in one go
+typedef struct {
+    /* index into the batch's curves */
+    int curve;
+    int segments;
+    int first;
+    int count;
+    /* where its count + 1 points go in the batch's vertices */
+    int vertex;
+} TessellationItem;
+
+// a worker's share of the items, taken from the front by its owner and stolen from the back
+typedef struct {
+    SDL_SpinLock lock;
+    int next;
+    int end;
+} TessellationQueue;
+
+/* Tessellates batches of curves across threads, which wait between batches. Curves with many segments are split
+   into spans, every span's points are given a place in one vertex buffer up front,
+   and the spans are dealt out to the workers' queues, which steal from each other
+   once their own run out. The result is a list of polylines ready to be drawn
+   together, in the same order whichever thread tessellated what. */
+typedef struct {
+    int worker_count;
+    BezierPrecision precision;
+    TessellationQueue queues[MAX_WORKER_THREADS];
+    WorkerThreads workers;
+    TessellationItem * items;
+    int item_count;
+    /* current batch: curve i uses points[4 * curves[i]] and weights[4 * curves[i]] */
+    Vec2 * points;
+    float * weights;
+    const int * curves;
+    /* results, in the frame arena: polyline i is vertices[polyline_starts[i]] up to
+       vertices[polyline_starts[i + 1]] */
+    Vec2 * vertices;
+    int * polyline_starts;
+} TessellationPool;
+
+// a curve's polyline in world space, tessellated finely enough for one zoom level
+typedef struct {
+    /* -1 for an empty slot */
+    int curve;
+    /* integer view log_scale it was tessellated for */
+    int level;
+    /* the control points and weights it was tessellated from, so changes to the curve are noticed */
+    Vec2 points[4];
+    float weights[4];
+    /* vertices[first] up to vertices[first + count] */
+    int first;
+    int count;
+    /* times it has been updated in place since it was tessellated */
+    int updates;
+} PolylineCacheEntry;
+
+/* Polylines kept between frames, so that panning (and zooming within a level) only
+   has to transform them. Entries are in an open addressing hash table keyed by curve,
+   which is emptied whenever it gets half full. Replaced polylines are left in the
+   vertex buffer until most of it is stale, then the rest are compacted. */
+typedef struct {
+    PolylineCacheEntry * entries;
+    int entries_capacity;
+    int entry_count;
+    Vec2 * vertices;
+    int vertex_count;
+    int vertices_capacity;
+    /* vertices still used by an entry */
+    int live_vertex_count;
+    /* where vertices are compacted into, before swapping buffers */
+    Vec2 * spare_vertices;
+    int spare_vertices_capacity;
+} PolylineCache;
+
+// most intervals of t an arc length table is split into
+#define ARC_LENGTH_TABLE_SIZE 64
+
+/* A curve's arc length from its start to each of count + 1 increasing values of t
+   (from 0 to 1), and its speed |dP/dt| there, which is enough to invert the arc
+   length with monotonic cubic interpolation. The values of t are picked so that
+   interpolation is accurate, so they bunch up where the speed changes quickly, as
+   it does with very uneven weights. */
+typedef struct {
+    int count;
+    float ts[ARC_LENGTH_TABLE_SIZE + 1];
+    float lengths[ARC_LENGTH_TABLE_SIZE + 1];
+    float speeds[ARC_LENGTH_TABLE_SIZE + 1];
+} ArcLengthTable;
+
+typedef struct {
+    /* -1 for an empty slot */
+    int curve;
+    /* the control points and weights the table was built from, so changes to the curve are noticed */
     Vec2 points[4];
-    /* sliders */
-    float sliders_value[4];
-    int sliders_x1;
-    int sliders_x2;
-    int sliders_y[4];
-    /* viewport translation and scaling */
-    Vec2 view_center;
-    float view_log_scale;
+    float weights[4];
+    ArcLengthTable table;
+} ArcLengthCacheEntry;
+
+/* Arc length tables of the curves that have been measured, in an open addressing
+   hash table keyed by curve like PolylineCache, emptied whenever it gets half full */
+typedef struct {
+    ArcLengthCacheEntry * entries;
+    int entries_capacity;
+    int entry_count;
+} ArcLengthCache;
+
+// where drawing goes: exactly one of renderer and software is set
+typedef struct {
+    SDL_Renderer * renderer;
+    SoftwareRenderer * software;
+    /* with a renderer, paths are filled on the CPU into a transparent layer the size
+       of the output, which is then drawn through a streaming texture */
+    SoftwareRenderer fill_layer;
+    SDL_Texture * fill_texture;
+    /* the rows spanned by paths filled since anything else was drawn, which are drawn
+       from the layer all at once before the next thing is */
+    SDL_Rect fill_rows;
+    /* with a renderer, polylines are drawn as thin quads through these, so that any
+       number of them is a single SDL_RenderGeometry call */
+    SDL_Vertex * line_vertices;
+    int line_vertices_capacity;
+    int * line_indices;
+    int line_indices_capacity;
+} Canvas;
+
+/* Viewport translation and scaling, along with the window size. The scale and its
+   reciprocal are worked out by Viewport_set whenever the view changes, so points can
+   be transformed without any calls to pow or divisions. */
+typedef struct {
+    Vec2 center;
+    float log_scale;
+    int width;
+    int height;
+    /* world units per pixel, and pixels per world unit */
+    float scale;
+    float inv_scale;
+    /* view position of the center */
+    Vec2 half_size;
+} Viewport;
+
+// everything a frame is drawn from, copied out of the render state by RenderState_publish
+typedef struct {
+    CurveDocument doc;
+    int active_curve;
+    Viewport view;
+} SceneSnapshot;
+
+// set alongside a snapshot index when that snapshot hasn't been drawn yet
+#define SNAPSHOT_FRESH 4
+
+// where the slider box and its contents go for a given window size
+typedef struct {
+    SDL_Rect box;
+    int inner_padding;
+    /* slider lines go from x1 to x2, and slider i is at height y[i] */
+    int x1;
+    int x2;
+    int y[4];
+} SliderLayout;
+
+/* The interaction state is only touched by the event handlers, under the mutex. Each
+   change is published as a snapshot through a triple buffer: the handlers fill the
+   back snapshot and swap it with the middle one, and render() swaps the middle one
+   with the front snapshot it draws from, so neither side ever waits for the other.
+   In the window, render() runs on the render thread, which sleeps on published until
+   there is a snapshot to draw. */
+// TODO max/min viewport scaling? Checks that we aren't dividing by 0 at any point?
+typedef struct {
+    /* bezier curves */
+    CurveDocument doc;
+    PointGrid grid;
+    /* the curve whose weights are shown on the sliders */
+    int active_curve;
+    /* viewport translation and scaling, and window size */
+    Viewport view;
     /* selection state */
     MouseSelectionState selected;
     int selected_index;
-    /* window info */
-    int window_width;
-    int window_height;
+    /* mouse position of the last event that had one (or at startup, before any), which
+       wheel zooming is centred on */
+    int mouse_x;
+    int mouse_y;
+    /* width of a slider label, which is constant as the font is monospace */
+    int label_width;
+    /* change tracking (DirtyFlags), cleared whenever a snapshot is published */
+    int dirty;
+    /* snapshot triple buffer: the middle index is exchanged atomically */
+    SceneSnapshot snapshots[3];
+    int snapshot_back;
+    int snapshot_front;
+    SDL_atomic_t snapshot_middle;
+    /* render side only: slider labels, only reformatted when the slider value changes */
+    char sliders_label[4][5];
+    float sliders_label_value[4];
+    /* render side only: memory for buffers only needed while drawing a frame */
+    FrameArena frame_arena;
+    TessellationPool tessellation;
+    PolylineCache polyline_cache;
     /* helpful pointers */
-    SDL_Renderer * renderer;
+    Canvas canvas;
     TTF_Font * font;
-    /* thread safety */
+    GlyphAtlas atlas;
+    /* thread safety: published is signalled, under the mutex, whenever a snapshot is */
     SDL_mutex * mutex;
+    SDL_cond * published;
 } RenderState;
 
-/* TODO may want to change convention to returning true on error
-   This would apply to RenderState_init and render
-   Means we can change the return values in a consistent manner
-*/
-bool RenderState_init(RenderState * state, SDL_Renderer * renderer, TTF_Font * font) {
-    assert(!state->mutex);
+// the texture is only created if there is a renderer to create it with
+bool GlyphAtlas_init(GlyphAtlas * atlas, SDL_Renderer * renderer, TTF_Font * font) {
+    SDL_Surface * text_surface = TTF_RenderText_Solid(font, ATLAS_CHARS, (SDL_Color) { 0xFF, 0xFF, 0xFF });
+    if (!text_surface) {
+        printf("Failed to render glyph atlas surface: %s\n", TTF_GetError());
+        return false;
+    }
 
-    int win_width = INITIAL_SCREEN_WIDTH;
-    int win_height = INITIAL_SCREEN_HEIGHT;
+    // converting turns the transparent colour key into alpha
+    atlas->surface = SDL_ConvertSurfaceFormat(text_surface, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(text_surface);
+    if (!atlas->surface) {
+        printf("Failed to convert glyph atlas surface: %s\n", SDL_GetError());
+        return false;
+    }
 
-    state->points[0] = (Vec2) { -win_width / 4, -win_height / 4 };
-    state->points[1] = (Vec2) { -win_width / 4, win_height / 4 };
-    state->points[2] = (Vec2) { win_width / 4, win_height / 4 };
-    state->points[3] = (Vec2) { win_width / 4, -win_height / 4 };
+    atlas->width = atlas->surface->w;
+    atlas->height = atlas->surface->h;
 
-    for (int i = 0; i < 4; i++) {
-        state->sliders_value[i] = 1.00f;
+    if (renderer) {
+        atlas->texture = SDL_CreateTextureFromSurface(renderer, atlas->surface);
+        if (!atlas->texture) {
+            printf("Failed to create glyph atlas texture: %s\n", SDL_GetError());
+            return false;
+        }
     }
 
-    // sliders_x1, sliders_x2, sliders_y to be assigned by render()
-
-    state->view_center = (Vec2) { 0, 0 };
-    state->view_log_scale = 0;
+    // glyph boundaries are the widths of each prefix of the atlas string
+    for (int i = 0; i <= (int) ATLAS_CHAR_COUNT; i++) {
+        char prefix[ATLAS_CHAR_COUNT + 1];
+        memcpy(prefix, ATLAS_CHARS, i);
+        prefix[i] = '\0';
 
-    state->window_width = win_width;
-    state->window_height = win_height;
+        int prefix_width = 0;
+        if (i > 0 && TTF_SizeText(font, prefix, &prefix_width, NULL)) {
+            printf("Failed to measure glyph atlas text: %s\n", TTF_GetError());
+            return false;
+        }
+        atlas->glyph_x[i] = prefix_width;
+    }
 
-    state->selected = MOUSE_SELECTED_NONE;
+    return true;
+}
 
-    state->renderer = renderer;
-    state->font = font;
+void GlyphAtlas_cleanup(GlyphAtlas * atlas) {
+    if (atlas->texture) SDL_DestroyTexture(atlas->texture);
+    SDL_FreeSurface(atlas->surface);
+}
 
-    state->mutex = SDL_CreateMutex();
-    if (!state->mutex) {
-        printf("Could not create mutex: %s\n", SDL_GetError());
-        return false;
+int get_atlas_text_width(const GlyphAtlas * atlas, const char * text) {
+    int width = 0;
+    for (; *text; text++) {
+        const char * c = strchr(ATLAS_CHARS, *text);
+        assert(c && *c);
+        int glyph = c - ATLAS_CHARS;
+        width += atlas->glyph_x[glyph + 1] - atlas->glyph_x[glyph];
     }
-
-    return true;
+    return width;
 }
 
-void RenderState_cleanup(RenderState * state) {
-    SDL_DestroyMutex(state->mutex);
+/* appends a (source, destination) pair of rects per character of text, with its top
+   left corner at x, y, returning the new number of pairs */
+int add_atlas_text_rects(const GlyphAtlas * atlas, const char * text, int x, int y, SDL_Rect * rects, int count) {
+    for (; *text; text++) {
+        const char * c = strchr(ATLAS_CHARS, *text);
+        assert(c && *c);
+        int glyph = c - ATLAS_CHARS;
+        int glyph_width = atlas->glyph_x[glyph + 1] - atlas->glyph_x[glyph];
+
+        rects[2 * count] = (SDL_Rect) { atlas->glyph_x[glyph], 0, glyph_width, atlas->height };
+        rects[2 * count + 1] = (SDL_Rect) { x, y, glyph_width, atlas->height };
+
+        count++;
+        x += glyph_width;
+    }
+
+    return count;
 }
 
 Vec2 cubic_bezier(double t, Vec2 w[4]) {
@@ -132,6 +750,29 @@ Vec2 rational_cubic_bezier(double t, Vec2 w[4], float r[4]) {
     };
 }
 
+WeightPattern get_weight_pattern(float r[4]) {
+    if (r[1] != r[2] || r[0] != r[3]) return WEIGHTS_GENERAL;
+    return r[0] == r[1] ? WEIGHTS_POLYNOMIAL : WEIGHTS_SYMMETRIC;
+}
+
+// rational_cubic_bezier for weights with r0 = r3 and r1 = r2
+Vec2 symmetric_rational_cubic_bezier(double t, Vec2 w[4], float r[4]) {
+    double t2 = t * t;
+    double t3 = t2 * t;
+    double mt = 1 - t;
+    double mt2 = mt * mt;
+    double mt3 = mt2 * mt;
+
+    double outer = r[0];
+    double inner = 3 * r[1] * mt * t;
+    double basis = outer * (mt3 + t3) + inner;
+
+    return (Vec2) {
+        (outer * (mt3 * w[0].x + t3 * w[3].x) + inner * (mt * w[1].x + t * w[2].x))/basis,
+        (outer * (mt3 * w[0].y + t3 * w[3].y) + inner * (mt * w[1].y + t * w[2].y))/basis,
+    };
+}
+
 /* the whole point of this piece of code: to understand why attempting to normalise
    the sum in a simpler fashion would not work */
 Vec2 fake_rational_cubic_bezier(double t, Vec2 w[4], float r[4]) {
@@ -155,398 +796,6219 @@ Vec2 fake_rational_cubic_bezier(double t, Vec2 w[4], float r[4]) {
     };
 }
 
-Vec2 Vec2_add(Vec2 a, Vec2 b) {
-    return (Vec2) { a.x + b.x, a.y + b.y };
+/* rational_cubic_bezier with everything in single precision, doing the same
+   operations as the float batch kernels */
+Vec2 rational_cubic_bezier_float(float t, Vec2 w[4], float r[4]) {
+    float t2 = t * t;
+    float t3 = t2 * t;
+    float mt = 1 - t;
+    float mt2 = mt * mt;
+    float mt3 = mt2 * mt;
+
+    float f0 = r[0] * mt3;
+    float f1 = 3 * r[1] * mt2 * t;
+    float f2 = 3 * r[2] * mt * t2;
+    float f3 = r[3] * t3;
+    float inv_basis = 1 / (f0 + f1 + f2 + f3);
+
+    return (Vec2) {
+        (f0 * w[0].x + f1 * w[1].x + f2 * w[2].x + f3 * w[3].x) * inv_basis,
+        (f0 * w[0].y + f1 * w[1].y + f2 * w[2].y + f3 * w[3].y) * inv_basis,
+    };
 }
 
-Vec2 Vec2_sub(Vec2 a, Vec2 b) {
-    return (Vec2) { a.x - b.x, a.y - b.y };
+/* Squared speed |dP/dt|^2 of the rational cubic. With N and W the numerator and
+   denominator of the curve, P' = (N'W - NW') / W^2. The speed batch kernels do the
+   same operations in the same order. */
+double rational_cubic_bezier_speed_squared(double t, Vec2 w[4], float r[4]) {
+    double t2 = t * t;
+    double mt = 1 - t;
+    double mt2 = mt * mt;
+
+    double f0 = r[0] * (mt2 * mt);
+    double f1 = r[1] * (3 * mt2 * t);
+    double f2 = r[2] * (3 * mt * t2);
+    double f3 = r[3] * (t2 * t);
+    double g0 = r[0] * (-3 * mt2);
+    double g1 = r[1] * (3 * mt2 - 6 * mt * t);
+    double g2 = r[2] * (6 * mt * t - 3 * t2);
+    double g3 = r[3] * (3 * t2);
+
+    double basis = f0 + f1 + f2 + f3;
+    double basis_derivative = g0 + g1 + g2 + g3;
+    double x = f0 * w[0].x + f1 * w[1].x + f2 * w[2].x + f3 * w[3].x;
+    double y = f0 * w[0].y + f1 * w[1].y + f2 * w[2].y + f3 * w[3].y;
+    double x_derivative = g0 * w[0].x + g1 * w[1].x + g2 * w[2].x + g3 * w[3].x;
+    double y_derivative = g0 * w[0].y + g1 * w[1].y + g2 * w[2].y + g3 * w[3].y;
+
+    double vx = x_derivative * basis - x * basis_derivative;
+    double vy = y_derivative * basis - y * basis_derivative;
+    double basis2 = basis * basis;
+    return (vx * vx + vy * vy) / (basis2 * basis2);
 }
 
-// scale a point by a scalar
-Vec2 Vec2_scale(Vec2 p, float s) {
-    return (Vec2) { p.x * s, p.y * s };
+/* Batch versions of the evaluators above: evaluate the curve at each of the n
+   parameter values in ts, writing the results into separate x and y arrays.
+
+   The SIMD kernels perform exactly the same double precision operations in the
+   same order as the single value evaluator they mirror (no fused multiply-adds),
+   so every kernel gives bit-identical results to it. Each kernel returns how many
+   values it handled; the remainder is finished off with that scalar evaluator.
+
+   The exception is rational_cubic_bezier_batch, which picks its kernel from the
+   weights: only curves with general weights match rational_cubic_bezier bit for
+   bit. Polynomial and symmetric weights match cubic_bezier and
+   symmetric_rational_cubic_bezier instead, which agree with rational_cubic_bezier
+   only to within rounding. */
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define BEZIER_BATCH_SIMD
+/* AVX-512 implies FMA, which GCC would otherwise use to contract the kernels'
+   multiplies and adds into fused operations that round differently */
+#define BATCH_KERNEL_TARGET(target_name) __attribute__((target(target_name), optimize("fp-contract=off")))
+#endif
+
+typedef int (*CubicBezierBatchKernel)(const double * ts, int n, Vec2 w[4], float * xs, float * ys);
+typedef int (*RationalBezierBatchKernel)(const double * ts, int n, Vec2 w[4], float r[4], float * xs, float * ys);
+typedef int (*FloatRationalBezierBatchKernel)(const float * ts, int n, Vec2 w[4], float r[4], float * xs, float * ys);
+typedef int (*SpeedBatchKernel)(const double * ts, int n, Vec2 w[4], float r[4], double * speeds_squared);
+
+static int cubic_bezier_batch_none(const double * ts, int n, Vec2 w[4], float * xs, float * ys) {
+    return 0;
 }
 
-// scale a point by the reciprocal of a scalar
-Vec2 Vec2_iscale(Vec2 p, float s) {
-    return (Vec2) { p.x / s, p.y / s };
+static int rational_bezier_batch_none(const double * ts, int n, Vec2 w[4], float r[4], float * xs, float * ys) {
+    return 0;
 }
 
-// TODO create constant for base and just inline this
-float get_actual_scale(float log_scale) {
-    return pow(1.1, log_scale);
+static int float_rational_bezier_batch_none(const float * ts, int n, Vec2 w[4], float r[4], float * xs, float * ys) {
+    return 0;
+}
+
+static int speed_batch_none(const double * ts, int n, Vec2 w[4], float r[4], double * speeds_squared) {
+    return 0;
 }
 
-Vec2 world_to_view_pos(Vec2 world_pos, Vec2 view_center, float view_log_scale, int disp_w, int disp_h) {
-    Vec2 result = Vec2_sub(world_pos, view_center);
+#ifdef BEZIER_BATCH_SIMD
+
+// generates the cubic, rational, symmetric rational and fake rational kernels for one instruction set
+#define DEFINE_BEZIER_BATCH_KERNELS(isa, target_name, lanes)                                         \
+typedef double isa##_vd __attribute__((vector_size(lanes * sizeof(double))));                        \
+typedef float isa##_vf __attribute__((vector_size(lanes * sizeof(float))));                          \
+                                                                                                     \
+BATCH_KERNEL_TARGET(target_name)                                                                     \
+static int cubic_bezier_batch_##isa(const double * ts, int n, Vec2 w[4], float * xs, float * ys) {   \
+    int i = 0;                                                                                       \
+    for (; i + lanes <= n; i += lanes) {                                                             \
+        isa##_vd t;                                                                                  \
+        memcpy(&t, ts + i, sizeof(t));                                                               \
+        isa##_vd t2 = t * t;                                                                         \
+        isa##_vd t3 = t2 * t;                                                                        \
+        isa##_vd mt = 1 - t;                                                                         \
+        isa##_vd mt2 = mt * mt;                                                                      \
+        isa##_vd mt3 = mt2 * mt;                                                                     \
+                                                                                                     \
+        isa##_vf x = __builtin_convertvector(                                                        \
+            mt3 * w[0].x + 3 * mt2 * t * w[1].x + 3 * mt * t2 * w[2].x + t3 * w[3].x, isa##_vf);     \
+        isa##_vf y = __builtin_convertvector(                                                        \
+            mt3 * w[0].y + 3 * mt2 * t * w[1].y + 3 * mt * t2 * w[2].y + t3 * w[3].y, isa##_vf);     \
+        memcpy(xs + i, &x, sizeof(x));                                                               \
+        memcpy(ys + i, &y, sizeof(y));                                                               \
+    }                                                                                                \
+    return i;                                                                                        \
+}                                                                                                    \
+                                                                                                     \
+BATCH_KERNEL_TARGET(target_name)                                                                     \
+static int rational_bezier_batch_##isa(const double * ts, int n, Vec2 w[4], float r[4],              \
+                                       float * xs, float * ys, bool fake) {                          \
+    int i = 0;                                                                                       \
+    for (; i + lanes <= n; i += lanes) {                                                             \
+        isa##_vd t;                                                                                  \
+        memcpy(&t, ts + i, sizeof(t));                                                               \
+        isa##_vd t2 = t * t;                                                                         \
+        isa##_vd t3 = t2 * t;                                                                        \
+        isa##_vd mt = 1 - t;                                                                         \
+        isa##_vd mt2 = mt * mt;                                                                      \
+        isa##_vd mt3 = mt2 * mt;                                                                     \
+                                                                                                     \
+        isa##_vd f0 = r[0] * mt3;                                                                    \
+        isa##_vd f1 = 3 * r[1] * mt2 * t;                                                            \
+        isa##_vd f2 = 3 * r[2] * mt * t2;                                                            \
+        isa##_vd f3 = r[3] * t3;                                                                     \
+        isa##_vd basis = fake                                                                        \
+            ? (isa##_vd) {0} + (double) (r[0] + r[1] + r[2] + r[3])                                  \
+            : f0 + f1 + f2 + f3;                                                                     \
+                                                                                                     \
+        isa##_vf x = __builtin_convertvector(                                                        \
+            (f0 * w[0].x + f1 * w[1].x + f2 * w[2].x + f3 * w[3].x)/basis, isa##_vf);                \
+        isa##_vf y = __builtin_convertvector(                                                        \
+            (f0 * w[0].y + f1 * w[1].y + f2 * w[2].y + f3 * w[3].y)/basis, isa##_vf);                \
+        memcpy(xs + i, &x, sizeof(x));                                                               \
+        memcpy(ys + i, &y, sizeof(y));                                                               \
+    }                                                                                                \
+    return i;                                                                                        \
+}                                                                                                    \
+                                                                                                     \
+BATCH_KERNEL_TARGET(target_name)                                                                     \
+static int symmetric_rational_bezier_batch_##isa(const double * ts, int n, Vec2 w[4], float r[4],    \
+                                                 float * xs, float * ys) {                           \
+    int i = 0;                                                                                       \
+    for (; i + lanes <= n; i += lanes) {                                                             \
+        isa##_vd t;                                                                                  \
+        memcpy(&t, ts + i, sizeof(t));                                                               \
+        isa##_vd t2 = t * t;                                                                         \
+        isa##_vd t3 = t2 * t;                                                                        \
+        isa##_vd mt = 1 - t;                                                                         \
+        isa##_vd mt2 = mt * mt;                                                                      \
+        isa##_vd mt3 = mt2 * mt;                                                                     \
+                                                                                                     \
+        double outer = r[0];                                                                         \
+        isa##_vd inner = 3 * r[1] * mt * t;                                                          \
+        isa##_vd basis = outer * (mt3 + t3) + inner;                                                 \
+                                                                                                     \
+        isa##_vf x = __builtin_convertvector(                                                        \
+            (outer * (mt3 * w[0].x + t3 * w[3].x) + inner * (mt * w[1].x + t * w[2].x))/basis,       \
+            isa##_vf);                                                                               \
+        isa##_vf y = __builtin_convertvector(                                                        \
+            (outer * (mt3 * w[0].y + t3 * w[3].y) + inner * (mt * w[1].y + t * w[2].y))/basis,       \
+            isa##_vf);                                                                               \
+        memcpy(xs + i, &x, sizeof(x));                                                               \
+        memcpy(ys + i, &y, sizeof(y));                                                               \
+    }                                                                                                \
+    return i;                                                                                        \
+}                                                                                                    \
+                                                                                                     \
+static int real_rational_bezier_batch_##isa(const double * ts, int n, Vec2 w[4], float r[4],         \
+                                            float * xs, float * ys) {                                \
+    return rational_bezier_batch_##isa(ts, n, w, r, xs, ys, false);                                  \
+}                                                                                                    \
+                                                                                                     \
+static int fake_rational_bezier_batch_##isa(const double * ts, int n, Vec2 w[4], float r[4],         \
+                                            float * xs, float * ys) {                                \
+    return rational_bezier_batch_##isa(ts, n, w, r, xs, ys, true);                                   \
+}
 
-    result = Vec2_iscale(result, get_actual_scale(view_log_scale));
+DEFINE_BEZIER_BATCH_KERNELS(sse2, "sse2", 2)
+DEFINE_BEZIER_BATCH_KERNELS(avx2, "avx2", 4)
+DEFINE_BEZIER_BATCH_KERNELS(avx512, "avx512f", 8)
+
+// the single precision rational kernel, which fits twice as many lanes in a register
+#define DEFINE_FLOAT_BEZIER_BATCH_KERNEL(isa, target_name, lanes)                                    \
+typedef float isa##_float_vf __attribute__((vector_size(lanes * sizeof(float))));                    \
+                                                                                                     \
+BATCH_KERNEL_TARGET(target_name)                                                                     \
+static int float_rational_bezier_batch_##isa(const float * ts, int n, Vec2 w[4], float r[4],         \
+                                             float * xs, float * ys) {                               \
+    int i = 0;                                                                                       \
+    for (; i + lanes <= n; i += lanes) {                                                             \
+        isa##_float_vf t;                                                                            \
+        memcpy(&t, ts + i, sizeof(t));                                                               \
+        isa##_float_vf t2 = t * t;                                                                   \
+        isa##_float_vf t3 = t2 * t;                                                                  \
+        isa##_float_vf mt = 1 - t;                                                                   \
+        isa##_float_vf mt2 = mt * mt;                                                                \
+        isa##_float_vf mt3 = mt2 * mt;                                                               \
+                                                                                                     \
+        isa##_float_vf f0 = r[0] * mt3;                                                              \
+        isa##_float_vf f1 = 3 * r[1] * mt2 * t;                                                      \
+        isa##_float_vf f2 = 3 * r[2] * mt * t2;                                                      \
+        isa##_float_vf f3 = r[3] * t3;                                                               \
+        isa##_float_vf inv_basis = 1 / (f0 + f1 + f2 + f3);                                          \
+                                                                                                     \
+        isa##_float_vf x = (f0 * w[0].x + f1 * w[1].x + f2 * w[2].x + f3 * w[3].x) * inv_basis;      \
+        isa##_float_vf y = (f0 * w[0].y + f1 * w[1].y + f2 * w[2].y + f3 * w[3].y) * inv_basis;      \
+        memcpy(xs + i, &x, sizeof(x));                                                               \
+        memcpy(ys + i, &y, sizeof(y));                                                               \
+    }                                                                                                \
+    return i;                                                                                        \
+}
 
-    return Vec2_add(result, (Vec2) { disp_w / 2, disp_h / 2 });
+DEFINE_FLOAT_BEZIER_BATCH_KERNEL(sse2, "sse2", 4)
+DEFINE_FLOAT_BEZIER_BATCH_KERNEL(avx2, "avx2", 8)
+DEFINE_FLOAT_BEZIER_BATCH_KERNEL(avx512, "avx512f", 16)
+
+// the squared speed kernel, using the double vector types of DEFINE_BEZIER_BATCH_KERNELS
+#define DEFINE_SPEED_BATCH_KERNEL(isa, target_name, lanes)                                          \
+BATCH_KERNEL_TARGET(target_name)                                                                     \
+static int speed_batch_##isa(const double * ts, int n, Vec2 w[4], float r[4], double * speeds_squared) { \
+    int i = 0;                                                                                       \
+    for (; i + lanes <= n; i += lanes) {                                                             \
+        isa##_vd t;                                                                                  \
+        memcpy(&t, ts + i, sizeof(t));                                                               \
+        isa##_vd t2 = t * t;                                                                         \
+        isa##_vd mt = 1 - t;                                                                         \
+        isa##_vd mt2 = mt * mt;                                                                      \
+                                                                                                     \
+        isa##_vd f0 = r[0] * (mt2 * mt);                                                             \
+        isa##_vd f1 = r[1] * (3 * mt2 * t);                                                          \
+        isa##_vd f2 = r[2] * (3 * mt * t2);                                                          \
+        isa##_vd f3 = r[3] * (t2 * t);                                                               \
+        isa##_vd g0 = r[0] * (-3 * mt2);                                                             \
+        isa##_vd g1 = r[1] * (3 * mt2 - 6 * mt * t);                                                 \
+        isa##_vd g2 = r[2] * (6 * mt * t - 3 * t2);                                                  \
+        isa##_vd g3 = r[3] * (3 * t2);                                                               \
+                                                                                                     \
+        isa##_vd basis = f0 + f1 + f2 + f3;                                                          \
+        isa##_vd basis_derivative = g0 + g1 + g2 + g3;                                               \
+        isa##_vd x = f0 * w[0].x + f1 * w[1].x + f2 * w[2].x + f3 * w[3].x;                          \
+        isa##_vd y = f0 * w[0].y + f1 * w[1].y + f2 * w[2].y + f3 * w[3].y;                          \
+        isa##_vd x_derivative = g0 * w[0].x + g1 * w[1].x + g2 * w[2].x + g3 * w[3].x;               \
+        isa##_vd y_derivative = g0 * w[0].y + g1 * w[1].y + g2 * w[2].y + g3 * w[3].y;               \
+                                                                                                     \
+        isa##_vd vx = x_derivative * basis - x * basis_derivative;                                   \
+        isa##_vd vy = y_derivative * basis - y * basis_derivative;                                   \
+        isa##_vd basis2 = basis * basis;                                                             \
+        isa##_vd result = (vx * vx + vy * vy) / (basis2 * basis2);                                   \
+        memcpy(speeds_squared + i, &result, sizeof(result));                                         \
+    }                                                                                                \
+    return i;                                                                                        \
 }
 
-Vec2 view_to_world_pos(Vec2 view_pos, Vec2 view_center, float view_log_scale, int disp_w, int disp_h) {
-    Vec2 result = Vec2_sub(view_pos, (Vec2) { disp_w / 2, disp_h / 2 });
+DEFINE_SPEED_BATCH_KERNEL(sse2, "sse2", 2)
+DEFINE_SPEED_BATCH_KERNEL(avx2, "avx2", 4)
+DEFINE_SPEED_BATCH_KERNEL(avx512, "avx512f", 8)
 
-    result = Vec2_scale(result, get_actual_scale(view_log_scale));
+#endif
 
-    return Vec2_add(result, view_center);
+// kernels for Viewport_world_to_view_batch
+typedef int (*ViewTransformBatchKernel)(const Viewport * view, const Vec2 * world, int n, Vec2 * out);
+
+static int world_to_view_batch_none(const Viewport * view, const Vec2 * world, int n, Vec2 * out) {
+    return 0;
 }
 
-void draw_point(SDL_Renderer * renderer, Vec2 p) {
-    SDL_Rect point_rect = { p.x - POINT_SIZE / 2, p.y - POINT_SIZE / 2, POINT_SIZE, POINT_SIZE };
-    SDL_RenderFillRect(renderer, &point_rect);
+#ifdef BEZIER_BATCH_SIMD
+
+// the points are transformed as one long array of floats, alternating x and y
+#define DEFINE_VIEW_TRANSFORM_KERNEL(isa, target_name, lanes)                                       \
+typedef float isa##_view_vf __attribute__((vector_size(lanes * sizeof(float))));                    \
+                                                                                                    \
+BATCH_KERNEL_TARGET(target_name)                                                                    \
+static int world_to_view_batch_##isa(const Viewport * view, const Vec2 * world, int n, Vec2 * out) { \
+    isa##_view_vf center, half_size;                                                                \
+    for (int k = 0; k < lanes; k += 2) {                                                            \
+        center[k] = view->center.x;                                                                 \
+        center[k + 1] = view->center.y;                                                             \
+        half_size[k] = view->half_size.x;                                                           \
+        half_size[k + 1] = view->half_size.y;                                                       \
+    }                                                                                               \
+                                                                                                    \
+    int i = 0;                                                                                      \
+    for (; i + lanes / 2 <= n; i += lanes / 2) {                                                    \
+        isa##_view_vf p;                                                                            \
+        memcpy(&p, world + i, sizeof(p));                                                           \
+        p = (p - center) * view->inv_scale + half_size;                                             \
+        memcpy(out + i, &p, sizeof(p));                                                             \
+    }                                                                                               \
+    return i;                                                                                       \
 }
 
-bool check_mouse_on_point(int x, int y, Vec2 p) {
-    return x < p.x + POINT_SIZE / 2 && x >= p.x - POINT_SIZE / 2 && y < p.y + POINT_SIZE / 2 && y >= p.y - POINT_SIZE / 2;
+DEFINE_VIEW_TRANSFORM_KERNEL(sse2, "sse2", 4)
+DEFINE_VIEW_TRANSFORM_KERNEL(avx2, "avx2", 8)
+DEFINE_VIEW_TRANSFORM_KERNEL(avx512, "avx512f", 16)
+
+#endif
+
+static struct {
+    bool selected;
+    CubicBezierBatchKernel cubic;
+    RationalBezierBatchKernel rational;
+    RationalBezierBatchKernel symmetric_rational;
+    RationalBezierBatchKernel fake_rational;
+    FloatRationalBezierBatchKernel float_rational;
+    SpeedBatchKernel speed;
+    ViewTransformBatchKernel world_to_view;
+} bezier_batch_kernels = {
+    // the scalar evaluators, until the kernels are selected
+    .cubic = cubic_bezier_batch_none,
+    .rational = rational_bezier_batch_none,
+    .symmetric_rational = rational_bezier_batch_none,
+    .fake_rational = rational_bezier_batch_none,
+    .float_rational = float_rational_bezier_batch_none,
+    .speed = speed_batch_none,
+    .world_to_view = world_to_view_batch_none,
+};
+
+/* Picks the widest kernels the CPU supports. This writes to bezier_batch_kernels, so
+   main calls it at startup, before any thread can be running the batch evaluators, and
+   so does TessellationPool_init, before its workers start. Calls after the first only
+   read the selected flag. */
+void select_bezier_batch_kernels(void) {
+    if (bezier_batch_kernels.selected) return;
+
+#ifdef BEZIER_BATCH_SIMD
+    if (SDL_HasAVX512F()) {
+        bezier_batch_kernels.cubic = cubic_bezier_batch_avx512;
+        bezier_batch_kernels.rational = real_rational_bezier_batch_avx512;
+        bezier_batch_kernels.symmetric_rational = symmetric_rational_bezier_batch_avx512;
+        bezier_batch_kernels.fake_rational = fake_rational_bezier_batch_avx512;
+        bezier_batch_kernels.float_rational = float_rational_bezier_batch_avx512;
+        bezier_batch_kernels.speed = speed_batch_avx512;
+        bezier_batch_kernels.world_to_view = world_to_view_batch_avx512;
+    } else if (SDL_HasAVX2()) {
+        bezier_batch_kernels.cubic = cubic_bezier_batch_avx2;
+        bezier_batch_kernels.rational = real_rational_bezier_batch_avx2;
+        bezier_batch_kernels.symmetric_rational = symmetric_rational_bezier_batch_avx2;
+        bezier_batch_kernels.fake_rational = fake_rational_bezier_batch_avx2;
+        bezier_batch_kernels.float_rational = float_rational_bezier_batch_avx2;
+        bezier_batch_kernels.speed = speed_batch_avx2;
+        bezier_batch_kernels.world_to_view = world_to_view_batch_avx2;
+    } else if (SDL_HasSSE2()) {
+        bezier_batch_kernels.cubic = cubic_bezier_batch_sse2;
+        bezier_batch_kernels.rational = real_rational_bezier_batch_sse2;
+        bezier_batch_kernels.symmetric_rational = symmetric_rational_bezier_batch_sse2;
+        bezier_batch_kernels.fake_rational = fake_rational_bezier_batch_sse2;
+        bezier_batch_kernels.float_rational = float_rational_bezier_batch_sse2;
+        bezier_batch_kernels.speed = speed_batch_sse2;
+        bezier_batch_kernels.world_to_view = world_to_view_batch_sse2;
+    }
+#endif
+
+    bezier_batch_kernels.selected = true;
 }
 
-int slider_value_to_x(float value, int x1, int x2) {
-    assert(SLIDER_MAX > SLIDER_MIN);
-    assert(x2 > x1);
-    return x1 + (value - SLIDER_MIN) * (x2 - x1) / (SLIDER_MAX - SLIDER_MIN);
+void cubic_bezier_batch(const double * ts, int n, Vec2 w[4], float * xs, float * ys) {
+    for (int i = bezier_batch_kernels.cubic(ts, n, w, xs, ys); i < n; i++) {
+        Vec2 p = cubic_bezier(ts[i], w);
+        xs[i] = p.x;
+        ys[i] = p.y;
+    }
 }
 
-float slider_x_to_value(int x, int x1, int x2) {
-    assert(SLIDER_MAX > SLIDER_MIN);
-    assert(x2 > x1);
-    assert(x1 <= x && x <= x2);
-    return SLIDER_MIN + (x - x1) * (SLIDER_MAX - SLIDER_MIN) / (x2 - x1);
+void symmetric_rational_cubic_bezier_batch(const double * ts, int n, Vec2 w[4], float r[4], float * xs, float * ys) {
+    for (int i = bezier_batch_kernels.symmetric_rational(ts, n, w, r, xs, ys); i < n; i++) {
+        Vec2 p = symmetric_rational_cubic_bezier(ts[i], w, r);
+        xs[i] = p.x;
+        ys[i] = p.y;
+    }
 }
 
-void draw_line_between_points(SDL_Renderer * renderer, Vec2 p1, Vec2 p2) {
-    SDL_RenderDrawLine(renderer, p1.x, p1.y, p2.x, p2.y);
+/* Evaluates the rational cubic with the cheapest kernel its weights allow. Only
+   general weights give bit-identical results to rational_cubic_bezier; the
+   polynomial and symmetric kernels agree with it to within rounding. */
+void rational_cubic_bezier_batch(const double * ts, int n, Vec2 w[4], float r[4], float * xs, float * ys) {
+    switch (get_weight_pattern(r)) {
+        case WEIGHTS_POLYNOMIAL: cubic_bezier_batch(ts, n, w, xs, ys); return;
+        case WEIGHTS_SYMMETRIC: symmetric_rational_cubic_bezier_batch(ts, n, w, r, xs, ys); return;
+        case WEIGHTS_GENERAL: break;
+    }
+
+    for (int i = bezier_batch_kernels.rational(ts, n, w, r, xs, ys); i < n; i++) {
+        Vec2 p = rational_cubic_bezier(ts[i], w, r);
+        xs[i] = p.x;
+        ys[i] = p.y;
+    }
 }
 
-bool render(RenderState * state) {
-    SDL_Renderer * const renderer = state->renderer;
-    TTF_Font * const font = state->font;
+void fake_rational_cubic_bezier_batch(const double * ts, int n, Vec2 w[4], float r[4], float * xs, float * ys) {
+    for (int i = bezier_batch_kernels.fake_rational(ts, n, w, r, xs, ys); i < n; i++) {
+        Vec2 p = fake_rational_cubic_bezier(ts[i], w, r);
+        xs[i] = p.x;
+        ys[i] = p.y;
+    }
+}
 
-    if (SDL_LockMutex(state->mutex)) assert(0);
+void rational_cubic_bezier_batch_float(const float * ts, int n, Vec2 w[4], float r[4], float * xs, float * ys) {
+    for (int i = bezier_batch_kernels.float_rational(ts, n, w, r, xs, ys); i < n; i++) {
+        Vec2 p = rational_cubic_bezier_float(ts[i], w, r);
+        xs[i] = p.x;
+        ys[i] = p.y;
+    }
+}
 
-    // clear screen
-    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-    SDL_RenderClear(renderer);
+// |dP/dt| at each of the n parameter values in ts
+void rational_cubic_bezier_speed_batch(const double * ts, int n, Vec2 w[4], float r[4], double * speeds) {
+    for (int i = bezier_batch_kernels.speed(ts, n, w, r, speeds); i < n; i++) {
+        speeds[i] = rational_cubic_bezier_speed_squared(ts[i], w, r);
+    }
+    for (int i = 0; i < n; i++) {
+        speeds[i] = sqrt(speeds[i]);
+    }
+}
 
-    // calculate actual point positions
-    Vec2 point_positions[4];
+/* Fills out with segments + 1 points evenly spaced in t along the rational cubic.
+
+   The weighted control points are lifted into homogeneous (wx, wy, w) space, where
+   the curve is an ordinary cubic polynomial, and stepped with forward differences,
+   so each sample costs nine additions and a single reciprocal (six additions and
+   no reciprocal when the weights are all equal). Everything is kept
+   in double precision: the accumulated error grows roughly with segments^3 times
+   machine epsilon, which stays far below float precision for any segment count we
+   would draw, and the end point is written exactly.
+
+   Only segments first to first + count - 1 are stepped through, writing count + 1
+   points, so a curve can be split into spans that are tessellated separately. */
+void rational_cubic_bezier_tessellate_span(Vec2 w[4], float r[4], int segments, int first, int count, Vec2 * out) {
+    assert(segments > 0);
+    assert(first >= 0 && count > 0 && first + count <= segments);
+
+    // equal weights cancel out, so they may as well all be 1, which keeps the w coordinate at 1
+    bool polynomial = get_weight_pattern(r) == WEIGHTS_POLYNOMIAL;
+
+    // weighted control points in homogeneous coordinates
+    double v[4][3];
     for (int i = 0; i < 4; i++) {
-        point_positions[i] = world_to_view_pos(
-            state->points[i],
-            state->view_center,
-            state->view_log_scale,
-            state->window_width,
-            state->window_height
-        );
+        double weight = polynomial ? 1 : r[i];
+        v[i][0] = weight * w[i].x;
+        v[i][1] = weight * w[i].y;
+        v[i][2] = weight;
     }
 
-    // draw bezier curve
-    {
-        SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0xFF, 0xFF);
+    double h = 1.0 / segments;
+    double h2 = h * h;
+    double h3 = h2 * h;
+    double t0 = first * h;
+
+    // p is the current value, d1-d3 are its first to third forward differences
+    double p[3], d1[3], d2[3], d3[3];
+    for (int k = 0; k < 3; k++) {
+        // power basis coefficients: a + b t + c t^2 + d t^3
+        double a = v[0][k];
+        double b = 3 * (v[1][k] - v[0][k]);
+        double c = 3 * (v[0][k] - 2 * v[1][k] + v[2][k]);
+        double d = -v[0][k] + 3 * v[1][k] - 3 * v[2][k] + v[3][k];
+
+        // shift the polynomial to start at t0 (this leaves it unchanged for t0 = 0)
+        a += t0 * (b + t0 * (c + t0 * d));
+        b += t0 * (2 * c + 3 * t0 * d);
+        c += 3 * t0 * d;
+
+        p[k] = a;
+        d1[k] = b * h + c * h2 + d * h3;
+        d2[k] = 2 * c * h2 + 6 * d * h3;
+        d3[k] = 6 * d * h3;
+    }
 
-        // Vec2 prev = fake_rational_cubic_bezier(0, point_positions, state->sliders_value);
-        Vec2 prev = rational_cubic_bezier(0, point_positions, state->sliders_value);
-        for (int i = 1; i <= 100; i += 1) {
-            double t = (double) i / 100;
+    if (polynomial) {
+        for (int i = 0; i < count; i++) {
+            out[i] = (Vec2) { p[0], p[1] };
 
-            // Vec2 next = fake_rational_cubic_bezier(t, point_positions, state->sliders_value);
-            Vec2 next = rational_cubic_bezier(t, point_positions, state->sliders_value);
-            draw_line_between_points(renderer, prev, next);
-            prev = next;
+            for (int k = 0; k < 2; k++) {
+                p[k] += d1[k];
+                d1[k] += d2[k];
+                d2[k] += d3[k];
+            }
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            double inv = 1 / p[2];
+            out[i] = (Vec2) { p[0] * inv, p[1] * inv };
+
+            for (int k = 0; k < 3; k++) {
+                p[k] += d1[k];
+                d1[k] += d2[k];
+                d2[k] += d3[k];
+            }
         }
     }
 
+    if (first + count == segments) {
+        out[count] = w[3];
+    } else {
+        double inv = 1 / p[2];
+        out[count] = (Vec2) { p[0] * inv, p[1] * inv };
+    }
+}
 
-    // draw lines between start/end points and control points
-    SDL_SetRenderDrawColor(renderer, 0x00, 0xAA, 0xAA, 0xFF);
-    draw_line_between_points(renderer, point_positions[0], point_positions[1]);
-    draw_line_between_points(renderer, point_positions[1], point_positions[2]);
-    draw_line_between_points(renderer, point_positions[2], point_positions[3]);
+/* rational_cubic_bezier_tessellate_span on the single precision fast path. Forward
+   differencing in float would pile up too much error, so each point is evaluated
+   directly by the float batch kernels, a block at a time. */
+void rational_cubic_bezier_tessellate_span_float(Vec2 w[4], float r[4], int segments, int first, int count, Vec2 * out) {
+    assert(segments > 0);
+    assert(first >= 0 && count > 0 && first + count <= segments);
 
-    // draw start/end/control points
-    SDL_SetRenderDrawColor(renderer, 0xFF, 0x00, 0x00, 0xFF);
-    draw_point(renderer, point_positions[0]);
-    draw_point(renderer, point_positions[3]);
-    SDL_SetRenderDrawColor(renderer, 0x00, 0xFF, 0x00, 0xFF);
-    draw_point(renderer, point_positions[1]);
-    draw_point(renderer, point_positions[2]);
+    const int points = first + count == segments ? count : count + 1;
 
-    // draw container for sliders
-    // TODO could probably be more consistent with use of const
-    const int win_width = state->window_width;
-    const int win_height = state->window_height;
+    float ts[64], xs[64], ys[64];
+    for (int i = 0; i < points; i += 64) {
+        int block = points - i < 64 ? points - i : 64;
+        for (int k = 0; k < block; k++) {
+            ts[k] = (float) (first + i + k) / segments;
+        }
+        rational_cubic_bezier_batch_float(ts, block, w, r, xs, ys);
+        for (int k = 0; k < block; k++) {
+            out[i + k] = (Vec2) { xs[k], ys[k] };
+        }
+    }
 
-    const int slider_box_outer_padding = 20;
-    const int slider_box_width = win_width / 2 - slider_box_outer_padding;
-    const int slider_box_height = win_height / 6;
-    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xAA);
-    SDL_Rect box_rect = {
-        win_width - slider_box_width - slider_box_outer_padding,
-        win_height - slider_box_height - slider_box_outer_padding,
-        slider_box_width,
-        slider_box_height,
-    };
-    SDL_RenderFillRect(renderer, &box_rect);
+    if (points == count) out[count] = w[3];
+}
 
-    // draw slider text, lines and points
-    const int slider_box_inner_padding = slider_box_height / 5;
+// fills out with segments + 1 points along the whole curve
+void rational_cubic_bezier_tessellate(Vec2 w[4], float r[4], int segments, Vec2 * out) {
+    rational_cubic_bezier_tessellate_span(w, r, segments, 0, segments, out);
+}
 
-    // these variables remain constant between iterations in the following loop
-    int text_width;
-    int text_height;
-    int sliders_x1;
-    int sliders_x2;
+/* Picks the number of evenly spaced segments needed for the rational cubic's
+   polyline to stay within tolerance of the curve, in the same units as w.
+
+   This is Wang's formula applied to the homogeneous curve and carried through the
+   division. With coordinates centered on the control points, a homogeneous error
+   E(t) turns into at most (|E_xy| + radius |E_w|) / min(r) after projection, and a
+   cubic interpolated with n chords has |E| <= 6/8 max|second difference| / n^2. */
+int rational_cubic_bezier_segment_count(Vec2 w[4], float r[4], float tolerance) {
+    assert(tolerance > 0);
+
+    Vec2 min = w[0];
+    Vec2 max = w[0];
+    for (int i = 1; i < 4; i++) {
+        min = (Vec2) { fminf(min.x, w[i].x), fminf(min.y, w[i].y) };
+        max = (Vec2) { fmaxf(max.x, w[i].x), fmaxf(max.y, w[i].y) };
+    }
+    Vec2 center = { (min.x + max.x) / 2, (min.y + max.y) / 2 };
 
-    // TODO could do first iteration outside loop to avoid doing the same stuff repeatedly
+    double v[4][3];
+    double radius = 0;
+    double r_min = r[0];
     for (int i = 0; i < 4; i++) {
-        // calculating in full here to avoid integer rounding errors, subtracting 1 accounts for line height (1 pixel)
-        int current_row_offset = (slider_box_height - slider_box_inner_padding * 2 - 1) * i / 3;
-        int current_y = box_rect.y + slider_box_inner_padding + current_row_offset;
+        double dx = w[i].x - center.x;
+        double dy = w[i].y - center.y;
+        v[i][0] = r[i] * dx;
+        v[i][1] = r[i] * dy;
+        v[i][2] = r[i];
+        radius = fmax(radius, sqrt(dx * dx + dy * dy));
+        r_min = fmin(r_min, r[i]);
+    }
 
-        /* slider text */
+    double m_xy = 0;
+    double m_w = 0;
+    for (int i = 0; i < 2; i++) {
+        double ddx = v[i][0] - 2 * v[i + 1][0] + v[i + 2][0];
+        double ddy = v[i][1] - 2 * v[i + 1][1] + v[i + 2][1];
+        double ddw = v[i][2] - 2 * v[i + 1][2] + v[i + 2][2];
+        m_xy = fmax(m_xy, sqrt(ddx * ddx + ddy * ddy));
+        m_w = fmax(m_w, fabs(ddw));
+    }
 
-        char text_string[5];
-        snprintf(text_string, 5, "%.2f", state->sliders_value[i]);
+    assert(r_min > 0);
+    double segments = ceil(sqrt(0.75 * (m_xy + radius * m_w) / (r_min * tolerance)));
 
-        SDL_Surface * text_surface = TTF_RenderText_Solid(font, text_string, (SDL_Color) { 0xFF, 0xFF, 0xFF });
-        if (!text_surface) {
-            printf("Failed to render text surface: %s\n", TTF_GetError());
-            return false;
-        }
+    // also guards against NaN from points that have been scaled out of range
+    if (!(segments >= 1)) return 1;
+    if (segments > MAX_CURVE_SEGMENTS) return MAX_CURVE_SEGMENTS;
+    return segments;
+}
 
-        SDL_Texture * text_texture = SDL_CreateTextureFromSurface(renderer, text_surface);
-        if (!text_texture) {
-            SDL_FreeSurface(text_surface);
-            printf("Failed to create texture from rendered text: %s\n", SDL_GetError());
-            return false;
-        }
+/* heap allocations made for buffers that grow to fit (frame arenas, reserve_buffer and
+   curve documents), so that a run can check nothing is allocated once it warms up */
+int heap_allocation_count = 0;
 
-        // check text size remains constant (assuming monospace font)
-        assert(i == 0 || text_width == text_surface->w);
-        assert(i == 0 || text_height == text_surface->h);
+// grows a buffer that is kept between frames so it can hold at least count elements
+bool reserve_buffer(void ** buffer, int * capacity, int count, size_t element_size) {
+    if (count <= *capacity) return true;
 
-        text_width = text_surface->w;
-        text_height = text_surface->h;
-        SDL_FreeSurface(text_surface);
+    int new_capacity = *capacity ? *capacity : 64;
+    while (new_capacity < count) new_capacity *= 2;
 
-        int text_x = box_rect.x + box_rect.w - slider_box_inner_padding - text_width;
-        int text_y = current_y - text_height / 2;
+    void * new_buffer = realloc(*buffer, new_capacity * element_size);
+    heap_allocation_count++;
+    if (!new_buffer) {
+        printf("Could not grow buffer to %d elements\n", new_capacity);
+        return false;
+    }
 
-        SDL_Rect text_rect = { text_x, text_y, text_width, text_height };
-        SDL_RenderCopyEx(renderer, text_texture, NULL, &text_rect, 0, NULL, SDL_FLIP_NONE);
-        SDL_DestroyTexture(text_texture);
+    *buffer = new_buffer;
+    *capacity = new_capacity;
+    return true;
+}
 
-        /* slider lines */
+// everything handed out by a frame arena is aligned to this, which suits SSE loads
+#define FRAME_ARENA_ALIGNMENT 16
 
-        int line_width = slider_box_width - slider_box_inner_padding * 3 - text_width;
-        /* TODO x1 and x2 can only vary if we change the screen to be resizable, but
-           even then presumably not during calls to render(), so it would stay constant
-           in this loop */
-        int x1 = box_rect.x + slider_box_inner_padding;
-        int x2 = x1 + line_width;
-        // handle window resized too small
-        if (x2 <= x1) x2 = x1 + 1;
+static inline char * align_pointer(char * p) {
+    return (char *) (((uintptr_t) p + FRAME_ARENA_ALIGNMENT - 1) & ~(uintptr_t) (FRAME_ARENA_ALIGNMENT - 1));
+}
 
-        assert(i == 0 || sliders_x1 == x1);
-        assert(i == 0 || sliders_x2 == x2);
-        sliders_x1 = x1;
-        sliders_x2 = x2;
+void FrameArena_init(FrameArena * arena) {
+    *arena = (FrameArena) {0};
+}
 
-        SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-        SDL_RenderDrawLine(renderer, x1, current_y, x2, current_y);
+// frees the overflow allocations in the chain
+static void FrameArena_free_overflow(FrameArena * arena) {
+    while (arena->overflow) {
+        void * next = *(void **) arena->overflow;
+        free(arena->overflow);
+        arena->overflow = next;
+    }
+}
 
-        /* slider points*/
+void FrameArena_cleanup(FrameArena * arena) {
+    FrameArena_free_overflow(arena);
+    free(arena->memory);
+    *arena = (FrameArena) {0};
+}
 
-        int point_x = slider_value_to_x(state->sliders_value[i], x1, x2);
-        SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-        draw_point(renderer, (Vec2) { point_x, current_y });
+// returns size bytes that stay valid until the next reset, or NULL if out of memory
+void * FrameArena_alloc(FrameArena * arena, size_t size) {
+    arena->requested += size + FRAME_ARENA_ALIGNMENT - 1;
 
-        /* update render state*/
-        state->sliders_y[i] = current_y;
+    if (arena->memory) {
+        char * result = align_pointer(arena->memory + arena->used);
+        if (result + size <= arena->memory + arena->capacity) {
+            arena->used = result + size - arena->memory;
+            return result;
+        }
     }
 
-    /* update render state*/
-    state->sliders_x1 = sliders_x1;
-    state->sliders_x2 = sliders_x2;
+    // doesn't fit, so gets its own allocation with the chain pointer stored in front
+    char * overflow = malloc(sizeof(void *) + FRAME_ARENA_ALIGNMENT - 1 + size);
+    heap_allocation_count++;
+    if (!overflow) {
+        printf("Could not allocate %zu bytes of frame memory\n", size);
+        return NULL;
+    }
+    *(void **) overflow = arena->overflow;
+    arena->overflow = overflow;
 
-    // update screen
-    SDL_RenderPresent(renderer);
+    return align_pointer(overflow + sizeof(void *));
+}
 
-    if (SDL_UnlockMutex(state->mutex)) assert(0);
+/* Frees everything handed out since the last reset. Normally this just rewinds the
+   block, but after a frame that overflowed the block is replaced with one that would
+   have fit the whole frame. */
+void FrameArena_reset(FrameArena * arena) {
+    if (arena->overflow) {
+        FrameArena_free_overflow(arena);
+
+        // a bit of headroom so slowly growing scenes don't reallocate every frame
+        size_t capacity = arena->requested + arena->requested / 2;
+        free(arena->memory);
+        arena->memory = malloc(capacity);
+        heap_allocation_count++;
+        arena->capacity = arena->memory ? capacity : 0;
+        // not being able to grow just means overflowing again next frame
+    }
 
-    return true;
+    arena->used = 0;
+    arena->requested = 0;
 }
 
-void handle_window_event(SDL_Event e, RenderState * state) {
-    if (e.type != SDL_WINDOWEVENT) return;
-
-    switch (e.window.event) {
-        case SDL_WINDOWEVENT_SIZE_CHANGED:
-        {
-            if (SDL_LockMutex(state->mutex)) assert(0);
+double get_seconds(void) {
+    return (double) SDL_GetPerformanceCounter() / SDL_GetPerformanceFrequency();
+}
 
-            state->window_width = e.window.data1;
-            state->window_height = e.window.data2;
+#ifdef BEZIER_PROFILE
 
-            if (SDL_UnlockMutex(state->mutex)) assert(0);
+// timed from both the main thread and the render thread, under its lock
+Profiler profiler;
+const char * profile_trace_path = "trace.json";
 
-            render(state); // rerender
-        } break;
-    }
+void Profiler_record(Profiler * p, ProfileStage stage, double start) {
+    double duration = get_seconds() - start;
+    SDL_AtomicLock(&p->lock);
+    p->current.stage_seconds[stage] += duration;
+    p->events[p->event_count % PROFILE_TRACE_EVENTS] = (TraceEvent) { stage, SDL_ThreadID(), start, duration };
+    p->event_count++;
+    SDL_AtomicUnlock(&p->lock);
 }
 
-int handle_window_event_helper(void * state, SDL_Event * e) {
-    handle_window_event(*e, (RenderState *) state);
-    return 1;
+// draw calls are only counted by the render thread, which also ends the frames
+void Profiler_end_frame(Profiler * p) {
+    SDL_AtomicLock(&p->lock);
+    p->frames[p->frame_count % PROFILE_FRAMES] = p->current;
+    p->frame_count++;
+    p->current = (FrameProfile) {0};
+    SDL_AtomicUnlock(&p->lock);
 }
 
-// updates render state based on mouse events
-void handle_mouse_event(SDL_Event e, RenderState * state) {
-    if (e.type == SDL_MOUSEBUTTONDOWN ||
-        e.type == SDL_MOUSEBUTTONUP ||
-        e.type == SDL_MOUSEMOTION ||
-        e.type == SDL_MOUSEWHEEL
-    ) {
+/* Writes the recorded scopes in the Chrome trace event format, which chrome://tracing
+   and Perfetto can open, with times in microseconds from the oldest scope and a track
+   per thread. The render thread waits on the lock until the file is written. */
+bool Profiler_write_trace(Profiler * p, const char * path) {
+    FILE * file = fopen(path, "w");
+    if (!file) {
+        printf("Could not open %s for writing\n", path);
+        return false;
+    }
 
-        if (SDL_LockMutex(state->mutex)) assert(0);
+    SDL_AtomicLock(&p->lock);
 
-        switch (e.type) {
+    int first = p->event_count > PROFILE_TRACE_EVENTS ? p->event_count - PROFILE_TRACE_EVENTS : 0;
+    double origin = first < p->event_count ? p->events[first % PROFILE_TRACE_EVENTS].start : 0;
+    for (int i = first; i < p->event_count; i++) {
+        origin = fmin(origin, p->events[i % PROFILE_TRACE_EVENTS].start);
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int i = first; i < p->event_count; i++) {
+        const TraceEvent * event = &p->events[i % PROFILE_TRACE_EVENTS];
+        fprintf(
+            file,
+            "{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %lu}%s\n",
+            PROFILE_STAGE_NAMES[event->stage],
+            (event->start - origin) * 1e6,
+            event->duration * 1e6,
+            (unsigned long) event->thread,
+            i + 1 < p->event_count ? "," : ""
+        );
+    }
+    fprintf(file, "]}\n");
+    int written = p->event_count - first;
+    SDL_AtomicUnlock(&p->lock);
+
+    if (fclose(file)) {
+        printf("Failed to write %s\n", path);
+        return false;
+    }
+    printf("Wrote %d trace events to %s\n", written, path);
+    return true;
+}
+
+#endif
+
+// one thread per core, for work spread across threads
+int get_worker_count(void) {
+    int cpu_count = SDL_GetCPUCount();
+    return cpu_count < 1 ? 1 : cpu_count > MAX_WORKER_THREADS ? MAX_WORKER_THREADS : cpu_count;
+}
+
+bool WorkerThreads_init(WorkerThreads * workers) {
+    *workers = (WorkerThreads) {0};
+
+    workers->mutex = SDL_CreateMutex();
+    workers->start = SDL_CreateCond();
+    workers->done = SDL_CreateCond();
+    if (!workers->mutex || !workers->start || !workers->done) {
+        printf("Could not create worker thread synchronisation: %s\n", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
+// waits for a run to start, does its part of it if it has one, and reports back
+static int worker_thread_main(void * data) {
+    WorkerThread * thread = data;
+    WorkerThreads * workers = thread->owner;
+
+    if (SDL_LockMutex(workers->mutex)) assert(0);
+    for (;;) {
+        while (workers->generation == thread->generation && !workers->exiting) {
+            if (SDL_CondWait(workers->start, workers->mutex)) assert(0);
+        }
+        if (workers->exiting) break;
+        thread->generation = workers->generation;
+
+        if (thread->worker < workers->worker_count) {
+            WorkerFunction function = workers->function;
+            void * function_data = workers->data;
+            if (SDL_UnlockMutex(workers->mutex)) assert(0);
+            function(function_data, thread->worker);
+            if (SDL_LockMutex(workers->mutex)) assert(0);
+        }
+
+        if (++workers->finished == workers->thread_count) {
+            if (SDL_CondSignal(workers->done)) assert(0);
+        }
+    }
+    if (SDL_UnlockMutex(workers->mutex)) assert(0);
+
+    return 0;
+}
+
+/* Calls function(data, worker) for worker 0 up to worker_count - 1 at once, on this
+   thread and worker_count - 1 of the waiting threads, returning when all are done.
+   If threads can't be started the run just has fewer workers, down to this thread alone. */
+void WorkerThreads_run(WorkerThreads * workers, int worker_count, WorkerFunction function, void * data) {
+    if (worker_count > MAX_WORKER_THREADS) worker_count = MAX_WORKER_THREADS;
+
+    // the threads are all waiting between runs, so new ones can join without locking
+    while (workers->thread_count < worker_count - 1) {
+        WorkerThread * thread = &workers->thread_data[workers->thread_count];
+        *thread = (WorkerThread) { workers, workers->thread_count + 1, workers->generation };
+        workers->threads[workers->thread_count] = SDL_CreateThread(worker_thread_main, "worker", thread);
+        if (!workers->threads[workers->thread_count]) break;
+        workers->thread_count++;
+    }
+    if (worker_count > workers->thread_count + 1) worker_count = workers->thread_count + 1;
+
+    if (worker_count <= 1) {
+        function(data, 0);
+        return;
+    }
+
+    if (SDL_LockMutex(workers->mutex)) assert(0);
+    workers->function = function;
+    workers->data = data;
+    workers->worker_count = worker_count;
+    workers->finished = 0;
+    workers->generation++;
+    if (SDL_CondBroadcast(workers->start)) assert(0);
+    if (SDL_UnlockMutex(workers->mutex)) assert(0);
+
+    function(data, 0);
+
+    if (SDL_LockMutex(workers->mutex)) assert(0);
+    while (workers->finished < workers->thread_count) {
+        if (SDL_CondWait(workers->done, workers->mutex)) assert(0);
+    }
+    if (SDL_UnlockMutex(workers->mutex)) assert(0);
+}
+
+void WorkerThreads_cleanup(WorkerThreads * workers) {
+    if (workers->mutex) {
+        if (SDL_LockMutex(workers->mutex)) assert(0);
+        workers->exiting = true;
+        if (SDL_CondBroadcast(workers->start)) assert(0);
+        if (SDL_UnlockMutex(workers->mutex)) assert(0);
+    }
+    for (int i = 0; i < workers->thread_count; i++) {
+        SDL_WaitThread(workers->threads[i], NULL);
+    }
+
+    SDL_DestroyCond(workers->start);
+    SDL_DestroyCond(workers->done);
+    SDL_DestroyMutex(workers->mutex);
+    *workers = (WorkerThreads) {0};
+}
+
+// curves with more segments than this are split into spans, so one long curve can't hold up a worker
+#define TESSELLATION_SPAN_SEGMENTS 128
+// batches with fewer segments than this aren't worth waking threads for
+#define TESSELLATION_PARALLEL_SEGMENTS 16384
+
+// precision new tessellation pools use, which can be picked on the command line
+BezierPrecision tessellation_precision = BEZIER_PRECISION_DOUBLE;
+
+bool TessellationPool_init(TessellationPool * pool) {
+    *pool = (TessellationPool) {0};
+    pool->worker_count = get_worker_count();
+    pool->precision = tessellation_precision;
+
+    // the workers call the batch evaluators, so their kernels have to be picked before any start
+    select_bezier_batch_kernels();
+
+    return WorkerThreads_init(&pool->workers);
+}
+
+void TessellationPool_cleanup(TessellationPool * pool) {
+    WorkerThreads_cleanup(&pool->workers);
+}
+
+// takes the next item from a worker's own queue, or -1 if it is empty
+static int TessellationPool_pop(TessellationPool * pool, int worker) {
+    TessellationQueue * queue = &pool->queues[worker];
+    int item = -1;
+
+    SDL_AtomicLock(&queue->lock);
+    if (queue->next < queue->end) item = queue->next++;
+    SDL_AtomicUnlock(&queue->lock);
+
+    return item;
+}
+
+// moves the back half of another worker's queue over to this one, returning false if there was nothing to take
+static bool TessellationPool_steal(TessellationPool * pool, int worker) {
+    for (int i = 1; i < pool->worker_count; i++) {
+        TessellationQueue * victim = &pool->queues[(worker + i) % pool->worker_count];
+
+        SDL_AtomicLock(&victim->lock);
+        int end = victim->end;
+        int middle = victim->next + (end - victim->next) / 2;
+        victim->end = middle;
+        SDL_AtomicUnlock(&victim->lock);
+
+        if (middle < end) {
+            TessellationQueue * queue = &pool->queues[worker];
+            SDL_AtomicLock(&queue->lock);
+            queue->next = middle;
+            queue->end = end;
+            SDL_AtomicUnlock(&queue->lock);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// tessellates items until every queue is empty
+static void tessellation_worker(void * data, int worker) {
+    TessellationPool * pool = data;
+
+    for (;;) {
+        int i = TessellationPool_pop(pool, worker);
+        if (i == -1) {
+            if (!TessellationPool_steal(pool, worker)) break;
+            continue;
+        }
+
+        TessellationItem item = pool->items[i];
+        Vec2 * points = pool->points + 4 * pool->curves[item.curve];
+        float * weights = pool->weights + 4 * pool->curves[item.curve];
+        Vec2 * out = pool->vertices + item.vertex;
+        if (pool->precision == BEZIER_PRECISION_FLOAT) {
+            rational_cubic_bezier_tessellate_span_float(points, weights, item.segments, item.first, item.count, out);
+        } else {
+            rational_cubic_bezier_tessellate_span(points, weights, item.segments, item.first, item.count, out);
+        }
+    }
+
+}
+
+/* Tessellates count curves to within tolerance, curve i using points[4 * curves[i]]
+   and weights[4 * curves[i]], leaving the polylines in the pool's results. Those are
+   allocated from the arena, so only last until it is reset. */
+bool TessellationPool_run(
+    TessellationPool * pool,
+    FrameArena * arena,
+    Vec2 * points,
+    float * weights,
+    const int * curves,
+    int count,
+    float tolerance
+) {
+    pool->points = points;
+    pool->weights = weights;
+    pool->curves = curves;
+
+    int * segments = FrameArena_alloc(arena, sizeof(int) * count);
+    if (!segments) return false;
+
+    int item_count = 0;
+    for (int c = 0; c < count; c++) {
+        segments[c] = rational_cubic_bezier_segment_count(points + 4 * curves[c], weights + 4 * curves[c], tolerance);
+        item_count += (segments[c] + TESSELLATION_SPAN_SEGMENTS - 1) / TESSELLATION_SPAN_SEGMENTS;
+    }
+
+    pool->items = FrameArena_alloc(arena, sizeof(TessellationItem) * item_count);
+    pool->polyline_starts = FrameArena_alloc(arena, sizeof(int) * (item_count + 1));
+    if (!pool->items || !pool->polyline_starts) return false;
+
+    // split the curves into spans, giving each a place in the vertex buffer
+    int vertex_count = 0;
+    pool->item_count = 0;
+    for (int c = 0; c < count; c++) {
+        for (int first = 0; first < segments[c]; first += TESSELLATION_SPAN_SEGMENTS) {
+            int span = segments[c] - first;
+            if (span > TESSELLATION_SPAN_SEGMENTS) span = TESSELLATION_SPAN_SEGMENTS;
+            pool->items[pool->item_count++] = (TessellationItem) { c, segments[c], first, span, vertex_count };
+            vertex_count += span + 1;
+        }
+    }
+
+    pool->vertices = FrameArena_alloc(arena, sizeof(Vec2) * vertex_count);
+    if (!pool->vertices) return false;
+
+    for (int i = 0; i < pool->item_count; i++) {
+        pool->polyline_starts[i] = pool->items[i].vertex;
+    }
+    pool->polyline_starts[pool->item_count] = vertex_count;
+
+    // small batches are done on this thread alone
+    int worker_count = vertex_count - pool->item_count < TESSELLATION_PARALLEL_SEGMENTS ? 1 : pool->worker_count;
+
+    // deal out contiguous runs of items, so neighbouring spans mostly stay on one thread
+    for (int w = 0; w < pool->worker_count; w++) {
+        pool->queues[w].next = w < worker_count ? (long long) pool->item_count * w / worker_count : 0;
+        pool->queues[w].end = w < worker_count ? (long long) pool->item_count * (w + 1) / worker_count : 0;
+    }
+
+    // work dealt to threads that couldn't be started gets stolen by the others
+    WorkerThreads_run(&pool->workers, worker_count, tessellation_worker, pool);
+
+    return true;
+}
+
+// converts the cubic Bernstein coefficients v into power basis coefficients c[0] + c[1] t + c[2] t^2 + c[3] t^3
+void bezier_power_basis(const double v[4], double c[4]) {
+    c[0] = v[0];
+    c[1] = 3 * (v[1] - v[0]);
+    c[2] = 3 * (v[0] - 2 * v[1] + v[2]);
+    c[3] = -v[0] + 3 * v[1] - 3 * v[2] + v[3];
+}
+
+double evaluate_polynomial(const double * c, int degree, double t) {
+    double result = c[degree];
+    for (int i = degree - 1; i >= 0; i--) {
+        result = result * t + c[i];
+    }
+    return result;
+}
+
+/* Finds the roots in [0, 1] of the polynomial c[0] + c[1] t + ... + c[degree] t^degree
+   (degree at most 4), writing them in increasing order and returning how many there
+   are. The roots of the derivative split [0, 1] into pieces on which the polynomial
+   is monotonic, and each piece with a sign change is bisected. */
+int polynomial_roots_in_unit_interval(const double * c, int degree, double * roots) {
+    assert(degree <= 4);
+
+    while (degree > 0 && c[degree] == 0) degree--;
+    if (degree == 0) return 0;
+
+    if (degree == 1) {
+        double t = -c[0] / c[1];
+        if (t < 0 || t > 1) return 0;
+        roots[0] = t;
+        return 1;
+    }
+
+    double derivative[4];
+    for (int i = 1; i <= degree; i++) {
+        derivative[i - 1] = i * c[i];
+    }
+
+    double ends[6];
+    ends[0] = 0;
+    int end_count = 1 + polynomial_roots_in_unit_interval(derivative, degree - 1, ends + 1);
+    ends[end_count++] = 1;
+
+    int root_count = 0;
+    for (int i = 0; i + 1 < end_count; i++) {
+        double a = ends[i];
+        double b = ends[i + 1];
+        double fa = evaluate_polynomial(c, degree, a);
+        double fb = evaluate_polynomial(c, degree, b);
+
+        if (fa == 0) {
+            roots[root_count++] = a;
+        } else if ((fa < 0) != (fb < 0) && fb != 0) {
+            for (int iteration = 0; iteration < 64 && a < b; iteration++) {
+                double m = (a + b) / 2;
+                if (m == a || m == b) break;
+                double fm = evaluate_polynomial(c, degree, m);
+                if ((fm < 0) == (fa < 0)) {
+                    a = m;
+                    fa = fm;
+                } else {
+                    b = m;
+                }
+            }
+            roots[root_count++] = (a + b) / 2;
+        }
+    }
+    if (evaluate_polynomial(c, degree, 1) == 0) {
+        roots[root_count++] = 1;
+    }
+
+    return root_count;
+}
+
+bool BoundingBox_overlaps(BoundingBox a, BoundingBox b) {
+    return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y;
+}
+
+BoundingBox BoundingBox_union(BoundingBox a, BoundingBox b) {
+    return (BoundingBox) {
+        { fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y) },
+        { fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y) },
+    };
+}
+
+BoundingBox get_points_bounds(const Vec2 * points, int count) {
+    assert(count > 0);
+    BoundingBox result = { points[0], points[0] };
+    for (int i = 1; i < count; i++) {
+        result.min = (Vec2) { fminf(result.min.x, points[i].x), fminf(result.min.y, points[i].y) };
+        result.max = (Vec2) { fmaxf(result.max.x, points[i].x), fmaxf(result.max.y, points[i].y) };
+    }
+    return result;
+}
+
+/* Returns the tight axis aligned bounding box of a rational cubic. Besides the end
+   points, the extremes in x are where (X/W)' = 0 for the homogeneous polynomials X
+   and W, i.e. the roots of X'W - XW', which is only a quartic as the t^5 terms
+   cancel (and likewise for y). */
+BoundingBox rational_cubic_bezier_bounds(Vec2 w[4], float r[4]) {
+    double vx[4], vy[4], vw[4];
+    for (int i = 0; i < 4; i++) {
+        vx[i] = (double) r[i] * w[i].x;
+        vy[i] = (double) r[i] * w[i].y;
+        vw[i] = r[i];
+    }
+
+    double cx[4], cy[4], cw[4];
+    bezier_power_basis(vx, cx);
+    bezier_power_basis(vy, cy);
+    bezier_power_basis(vw, cw);
+
+    BoundingBox result = {
+        { fminf(w[0].x, w[3].x), fminf(w[0].y, w[3].y) },
+        { fmaxf(w[0].x, w[3].x), fmaxf(w[0].y, w[3].y) },
+    };
+
+    for (int axis = 0; axis < 2; axis++) {
+        const double * cp = axis == 0 ? cx : cy;
+
+        // coefficients of P'W - PW' up to t^4
+        double n[5] = {0};
+        for (int i = 1; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                if (i - 1 + j > 4) continue;
+                n[i - 1 + j] += i * (cp[i] * cw[j] - cw[i] * cp[j]);
+            }
+        }
+
+        double roots[4];
+        int root_count = polynomial_roots_in_unit_interval(n, 4, roots);
+        for (int k = 0; k < root_count; k++) {
+            Vec2 p = rational_cubic_bezier(roots[k], w, r);
+            if (axis == 0) {
+                result.min.x = fminf(result.min.x, p.x);
+                result.max.x = fmaxf(result.max.x, p.x);
+            } else {
+                result.min.y = fminf(result.min.y, p.y);
+                result.max.y = fmaxf(result.max.y, p.y);
+            }
+        }
+    }
+
+    return result;
+}
+
+// maps a whole file read only, returning NULL if it can't be
+const void * map_file(const char * path, size_t * size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("Could not open %s\n", path);
+        return NULL;
+    }
+
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    const void * view = NULL;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    if (mapping) {
+        view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+
+    if (!view) {
+        printf("Could not map %s\n", path);
+        return NULL;
+    }
+    *size = file_size.QuadPart;
+    return view;
+#else
+    int file = open(path, O_RDONLY);
+    if (file == -1) {
+        printf("Could not open %s\n", path);
+        return NULL;
+    }
+
+    struct stat file_stat;
+    void * view = MAP_FAILED;
+    if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+        view = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file);
+
+    if (view == MAP_FAILED) {
+        printf("Could not map %s\n", path);
+        return NULL;
+    }
+    *size = file_stat.st_size;
+    return view;
+#endif
+}
+
+void unmap_file(const void * view, size_t size) {
+#ifdef _WIN32
+    (void) size;
+    UnmapViewOfFile(view);
+#else
+    munmap((void *) view, size);
+#endif
+}
+
+bool CurveDocument_init(CurveDocument * doc) {
+    *doc = (CurveDocument) {0};
+    return true;
+}
+
+void CurveDocument_cleanup(CurveDocument * doc) {
+    if (!doc->borrowed) {
+        free(doc->points);
+        free(doc->weights);
+        free(doc->bounds);
+        free(doc->chunk_bounds);
+    }
+    if (doc->mapping) unmap_file(doc->mapping, doc->mapping_size);
+    *doc = (CurveDocument) {0};
+}
+
+Vec2 * CurveDocument_points(const CurveDocument * doc, int curve) {
+    assert(0 <= curve && curve < doc->count);
+    return doc->points + 4 * curve;
+}
+
+float * CurveDocument_weights(const CurveDocument * doc, int curve) {
+    assert(0 <= curve && curve < doc->count);
+    return doc->weights + 4 * curve;
+}
+
+int CurveDocument_chunk_count(const CurveDocument * doc) {
+    return (doc->count + CURVE_CHUNK_SIZE - 1) / CURVE_CHUNK_SIZE;
+}
+
+// grows the arrays so they can hold at least capacity curves
+bool CurveDocument_reserve(CurveDocument * doc, int capacity) {
+    if (capacity < doc->count) capacity = doc->count;
+
+    // borrowed arrays are swapped for copies the document owns
+    if (doc->borrowed) {
+        CurveDocument copy = {0};
+        if (!CurveDocument_reserve(&copy, capacity)) {
+            CurveDocument_cleanup(&copy);
+            return false;
+        }
+
+        memcpy(copy.points, doc->points, sizeof(Vec2) * 4 * doc->count);
+        memcpy(copy.weights, doc->weights, sizeof(float) * 4 * doc->count);
+        memcpy(copy.bounds, doc->bounds, sizeof(BoundingBox) * doc->count);
+        memcpy(copy.chunk_bounds, doc->chunk_bounds, sizeof(BoundingBox) * CurveDocument_chunk_count(doc));
+        copy.count = doc->count;
+        copy.version = doc->version;
+        copy.mapping = doc->mapping;
+        copy.mapping_size = doc->mapping_size;
+
+        *doc = copy;
+        return true;
+    }
+
+    if (capacity <= doc->capacity) return true;
+    heap_allocation_count += 4;
+
+    Vec2 * new_points = realloc(doc->points, sizeof(Vec2) * 4 * capacity);
+    if (!new_points) {
+        printf("Could not grow curve document to %d curves\n", capacity);
+        return false;
+    }
+    doc->points = new_points;
+
+    float * new_weights = realloc(doc->weights, sizeof(float) * 4 * capacity);
+    if (!new_weights) {
+        printf("Could not grow curve document to %d curves\n", capacity);
+        return false;
+    }
+    doc->weights = new_weights;
+
+    BoundingBox * new_bounds = realloc(doc->bounds, sizeof(BoundingBox) * capacity);
+    if (!new_bounds) {
+        printf("Could not grow curve document to %d curves\n", capacity);
+        return false;
+    }
+    doc->bounds = new_bounds;
+
+    int chunk_capacity = (capacity + CURVE_CHUNK_SIZE - 1) / CURVE_CHUNK_SIZE;
+    BoundingBox * new_chunk_bounds = realloc(doc->chunk_bounds, sizeof(BoundingBox) * chunk_capacity);
+    if (!new_chunk_bounds) {
+        printf("Could not grow curve document to %d curves\n", capacity);
+        return false;
+    }
+    doc->chunk_bounds = new_chunk_bounds;
+
+    doc->capacity = capacity;
+    return true;
+}
+
+// recalculates the bounds of a chunk from the control points of its curves
+static void CurveDocument_update_chunk(CurveDocument * doc, int chunk) {
+    int first = chunk * CURVE_CHUNK_SIZE;
+    int count = doc->count - first < CURVE_CHUNK_SIZE ? doc->count - first : CURVE_CHUNK_SIZE;
+    doc->chunk_bounds[chunk] = get_points_bounds(doc->points + 4 * first, 4 * count);
+}
+
+bool CurveDocument_add_curve(CurveDocument * doc, Vec2 points[4], float weights[4]) {
+    if ((doc->count == doc->capacity || doc->borrowed) &&
+        !CurveDocument_reserve(doc, doc->count ? doc->count * 2 : 16)
+    ) {
+        return false;
+    }
+
+    memcpy(doc->points + 4 * doc->count, points, sizeof(Vec2) * 4);
+    memcpy(doc->weights + 4 * doc->count, weights, sizeof(float) * 4);
+    doc->bounds[doc->count] = rational_cubic_bezier_bounds(points, weights);
+
+    int chunk = doc->count / CURVE_CHUNK_SIZE;
+    BoundingBox points_bounds = get_points_bounds(points, 4);
+    doc->chunk_bounds[chunk] = doc->count % CURVE_CHUNK_SIZE
+        ? BoundingBox_union(doc->chunk_bounds[chunk], points_bounds)
+        : points_bounds;
+
+    doc->count++;
+    doc->version++;
+
+    return true;
+}
+
+// moves the document on a version, for an edit to a single curve
+static void CurveDocument_log_edit(CurveDocument * doc, int curve) {
+    doc->version++;
+    doc->edits[doc->version % CURVE_EDIT_LOG_SIZE] = (CurveEdit) { doc->version, curve };
+}
+
+/* Catches dst up with src by copying just the curves edited since dst's version, if
+   it is an owned copy of an earlier version of src and src remembers every edit since. */
+static bool CurveDocument_copy_edits(CurveDocument * dst, const CurveDocument * src) {
+    if (dst->borrowed || src->borrowed || dst->count != src->count ||
+        src->version < dst->version || src->version - dst->version > CURVE_EDIT_LOG_SIZE
+    ) {
+        return false;
+    }
+    for (int v = dst->version + 1; v <= src->version; v++) {
+        if (src->edits[v % CURVE_EDIT_LOG_SIZE].version != v) return false;
+    }
+
+    for (int v = dst->version + 1; v <= src->version; v++) {
+        int curve = src->edits[v % CURVE_EDIT_LOG_SIZE].curve;
+        int chunk = curve / CURVE_CHUNK_SIZE;
+        memcpy(CurveDocument_points(dst, curve), CurveDocument_points(src, curve), sizeof(Vec2) * 4);
+        memcpy(CurveDocument_weights(dst, curve), CurveDocument_weights(src, curve), sizeof(float) * 4);
+        dst->bounds[curve] = src->bounds[curve];
+        dst->chunk_bounds[chunk] = src->chunk_bounds[chunk];
+    }
+    dst->version = src->version;
+
+    return true;
+}
+
+/* Makes dst a copy of src, reusing dst's arrays where they are big enough. Borrowed
+   arrays can't change, so a copy of a borrowing document just borrows them too. A
+   copy that is only a few edits behind just has the edited curves copied over. */
+bool CurveDocument_copy(CurveDocument * dst, const CurveDocument * src) {
+    if (CurveDocument_copy_edits(dst, src)) return true;
+
+    if (src->borrowed) {
+        if (!dst->borrowed) {
+            free(dst->points);
+            free(dst->weights);
+            free(dst->bounds);
+            free(dst->chunk_bounds);
+        }
+        dst->points = src->points;
+        dst->weights = src->weights;
+        dst->bounds = src->bounds;
+        dst->chunk_bounds = src->chunk_bounds;
+        dst->borrowed = true;
+        dst->capacity = 0;
+    } else {
+        if (dst->borrowed) {
+            *dst = (CurveDocument) { .mapping = dst->mapping, .mapping_size = dst->mapping_size };
+        }
+        if (!CurveDocument_reserve(dst, src->count)) return false;
+
+        memcpy(dst->points, src->points, sizeof(Vec2) * 4 * src->count);
+        memcpy(dst->weights, src->weights, sizeof(float) * 4 * src->count);
+        memcpy(dst->bounds, src->bounds, sizeof(BoundingBox) * src->count);
+        memcpy(dst->chunk_bounds, src->chunk_bounds, sizeof(BoundingBox) * CurveDocument_chunk_count(src));
+    }
+    dst->count = src->count;
+    dst->version = src->version;
+
+    return true;
+}
+
+// moves a single control point (index is 4 * curve + point)
+bool CurveDocument_set_point(CurveDocument * doc, int index, Vec2 p) {
+    assert(0 <= index && index < doc->count * 4);
+    int curve = index / 4;
+
+    if (doc->borrowed && !CurveDocument_reserve(doc, doc->count)) return false;
+
+    doc->points[index] = p;
+    CurveDocument_log_edit(doc, curve);
+    doc->bounds[curve] = rational_cubic_bezier_bounds(CurveDocument_points(doc, curve), CurveDocument_weights(doc, curve));
+    CurveDocument_update_chunk(doc, curve / CURVE_CHUNK_SIZE);
+
+    return true;
+}
+
+bool CurveDocument_set_weight(CurveDocument * doc, int curve, int i, float weight) {
+    assert(0 <= i && i < 4);
+
+    if (doc->borrowed && !CurveDocument_reserve(doc, doc->count)) return false;
+
+    float * weights = CurveDocument_weights(doc, curve);
+    weights[i] = weight;
+    CurveDocument_log_edit(doc, curve);
+    doc->bounds[curve] = rational_cubic_bezier_bounds(CurveDocument_points(doc, curve), weights);
+
+    return true;
+}
+
+/* Scene files hold a curve document laid out exactly as it is in memory, so that it
+   can be mapped and used in place. The header is followed by blocks at the given
+   offsets (each aligned to SCENE_FILE_ALIGNMENT): the chunk index (bounds of each
+   chunk of curves, so chunks can be culled without looking at them), then the
+   control points, weights and bounds of all the curves. Everything is in native
+   byte order, which the magic number's byte order shows. */
+#define SCENE_FILE_MAGIC 0x5A424542 // "BEBZ" when read little endian
+#define SCENE_FILE_VERSION 1
+#define SCENE_FILE_ALIGNMENT 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t curve_count;
+    uint32_t chunk_size;
+    uint64_t chunk_index_offset;
+    uint64_t points_offset;
+    uint64_t weights_offset;
+    uint64_t bounds_offset;
+} SceneFileHeader;
+
+static uint64_t align_scene_offset(uint64_t offset) {
+    return (offset + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+}
+
+// writes a block followed by zeros up to where the next block starts
+static bool write_scene_block(FILE * file, uint64_t * offset, const void * data, size_t size) {
+    static const char zeros[SCENE_FILE_ALIGNMENT];
+    size_t padding = align_scene_offset(*offset + size) - (*offset + size);
+    *offset += size + padding;
+    return fwrite(data, 1, size, file) == size && fwrite(zeros, 1, padding, file) == padding;
+}
+
+// whether a block lies entirely within the file and is aligned
+static bool check_scene_block(uint64_t offset, uint64_t size, size_t file_size) {
+    return offset % SCENE_FILE_ALIGNMENT == 0 && offset <= file_size && size <= file_size - offset;
+}
+
+bool CurveDocument_save(const CurveDocument * doc, const char * path) {
+    FILE * file = fopen(path, "wb");
+    if (!file) {
+        printf("Could not open %s for writing\n", path);
+        return false;
+    }
+
+    size_t chunk_index_size = sizeof(BoundingBox) * CurveDocument_chunk_count(doc);
+    size_t points_size = sizeof(Vec2) * 4 * doc->count;
+    size_t weights_size = sizeof(float) * 4 * doc->count;
+    size_t bounds_size = sizeof(BoundingBox) * doc->count;
+
+    SceneFileHeader header = { SCENE_FILE_MAGIC, SCENE_FILE_VERSION, doc->count, CURVE_CHUNK_SIZE };
+    header.chunk_index_offset = align_scene_offset(sizeof(header));
+    header.points_offset = align_scene_offset(header.chunk_index_offset + chunk_index_size);
+    header.weights_offset = align_scene_offset(header.points_offset + points_size);
+    header.bounds_offset = align_scene_offset(header.weights_offset + weights_size);
+
+    uint64_t offset = 0;
+    bool success = write_scene_block(file, &offset, &header, sizeof(header)) &&
+        write_scene_block(file, &offset, doc->chunk_bounds, chunk_index_size) &&
+        write_scene_block(file, &offset, doc->points, points_size) &&
+        write_scene_block(file, &offset, doc->weights, weights_size) &&
+        write_scene_block(file, &offset, doc->bounds, bounds_size);
+
+    if (fclose(file) || !success) {
+        printf("Failed to write %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+/* Opens a scene file as a document borrowing its arrays from the mapped file. Only
+   the header is read here, so nothing else is paged in until it is used. */
+bool CurveDocument_map(CurveDocument * doc, const char * path) {
+    *doc = (CurveDocument) {0};
+
+    size_t size;
+    const char * data = map_file(path, &size);
+    if (!data) return false;
+
+    SceneFileHeader header;
+    if (size < sizeof(header)) {
+        printf("%s is too small to be a scene file\n", path);
+        unmap_file(data, size);
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    uint64_t count = header.curve_count;
+    uint64_t chunk_count = (count + CURVE_CHUNK_SIZE - 1) / CURVE_CHUNK_SIZE;
+    bool valid = header.magic == SCENE_FILE_MAGIC &&
+        header.version == SCENE_FILE_VERSION &&
+        header.chunk_size == CURVE_CHUNK_SIZE &&
+        count <= INT_MAX / 4 &&
+        check_scene_block(header.chunk_index_offset, sizeof(BoundingBox) * chunk_count, size) &&
+        check_scene_block(header.points_offset, sizeof(Vec2) * 4 * count, size) &&
+        check_scene_block(header.weights_offset, sizeof(float) * 4 * count, size) &&
+        check_scene_block(header.bounds_offset, sizeof(BoundingBox) * count, size);
+    if (!valid) {
+        printf("%s is not a scene file this version can read\n", path);
+        unmap_file(data, size);
+        return false;
+    }
+
+    doc->count = header.curve_count;
+    doc->points = (Vec2 *) (data + header.points_offset);
+    doc->weights = (float *) (data + header.weights_offset);
+    doc->bounds = (BoundingBox *) (data + header.bounds_offset);
+    doc->chunk_bounds = (BoundingBox *) (data + header.chunk_index_offset);
+    doc->borrowed = true;
+    doc->mapping = data;
+    doc->mapping_size = size;
+
+    return true;
+}
+
+/* NURBS curves are evaluated with de Boor's algorithm on the control points lifted
+   into homogeneous (wx, wy, w) space, where the curve is an ordinary B-spline, and
+   converted into rational cubics for the document by extracting the Bezier piece of
+   each knot span. */
+
+typedef struct {
+    double x;
+    double y;
+    double w;
+} HomogeneousPoint;
+
+static HomogeneousPoint HomogeneousPoint_lerp(HomogeneousPoint a, HomogeneousPoint b, double t) {
+    return (HomogeneousPoint) { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.w + (b.w - a.w) * t };
+}
+
+static Vec2 HomogeneousPoint_project(HomogeneousPoint p) {
+    return (Vec2) { p.x / p.w, p.y / p.w };
+}
+
+// checks a curve can be evaluated, printing what is wrong with it if not
+bool NurbsCurve_check(const NurbsCurve * curve) {
+    if (curve->degree < 1 || curve->degree > NURBS_MAX_DEGREE) {
+        printf("NURBS degree %d is not between 1 and %d\n", curve->degree, NURBS_MAX_DEGREE);
+        return false;
+    }
+    if (curve->count < curve->degree + 1) {
+        printf("NURBS curve of degree %d needs at least %d control points\n", curve->degree, curve->degree + 1);
+        return false;
+    }
+    for (int i = 0; i < curve->count; i++) {
+        if (!(curve->weights[i] > 0) || !isfinite(curve->weights[i])) {
+            printf("NURBS weight %d is not positive\n", i);
+            return false;
+        }
+    }
+    for (int i = 0; i < curve->count + curve->degree; i++) {
+        if (!(curve->knots[i] <= curve->knots[i + 1])) {
+            printf("NURBS knot %d is out of order\n", i + 1);
+            return false;
+        }
+    }
+    if (!(curve->knots[curve->degree] < curve->knots[curve->count])) {
+        printf("NURBS curve has an empty domain\n");
+        return false;
+    }
+    return true;
+}
+
+// the last non-empty span, which also takes in the end of the domain
+static int NurbsCurve_last_span(const NurbsCurve * curve) {
+    int last = curve->count - 1;
+    while (curve->knots[last] == curve->knots[last + 1]) last--;
+    return last;
+}
+
+/* Returns the span k with knots[k] <= t < knots[k + 1] that t is evaluated in. Values
+   outside the domain are put in the first or last (non-empty) span. */
+int NurbsCurve_find_span(const NurbsCurve * curve, double t) {
+    const double * knots = curve->knots;
+
+    int last = NurbsCurve_last_span(curve);
+    if (t >= knots[last]) return last;
+
+    int low = curve->degree;
+    int high = last;
+    if (t < knots[low]) t = knots[low];
+    // knots[low] <= t < knots[high]
+    while (high - low > 1) {
+        int middle = (low + high) / 2;
+        if (t < knots[middle]) high = middle;
+        else low = middle;
+    }
+    return low;
+}
+
+// the control points that affect span k, in homogeneous space
+static void NurbsCurve_lift_span(const NurbsCurve * curve, int span, HomogeneousPoint * local) {
+    for (int j = 0; j <= curve->degree; j++) {
+        int i = span - curve->degree + j;
+        double w = curve->weights[i];
+        local[j] = (HomogeneousPoint) { curve->points[i].x * w, curve->points[i].y * w, w };
+    }
+}
+
+/* de Boor's algorithm on the lifted control points of a span, with a different
+   parameter at each level: this gives the blossom of the span's polynomial at
+   u[0..degree - 1], which is the point on the curve when they are all the same */
+static HomogeneousPoint NurbsCurve_blossom(const NurbsCurve * curve, int span, const HomogeneousPoint * local,
+                                           const double * u) {
+    const int p = curve->degree;
+    const double * knots = curve->knots + span - p;
+
+    HomogeneousPoint d[NURBS_MAX_DEGREE + 1];
+    memcpy(d, local, sizeof(HomogeneousPoint) * (p + 1));
+
+    for (int r = 1; r <= p; r++) {
+        for (int j = p; j >= r; j--) {
+            double alpha = (u[r - 1] - knots[j]) / (knots[j + 1 + p - r] - knots[j]);
+            d[j] = HomogeneousPoint_lerp(d[j - 1], d[j], alpha);
+        }
+    }
+    return d[p];
+}
+
+Vec2 NurbsCurve_evaluate(const NurbsCurve * curve, double t) {
+    int span = NurbsCurve_find_span(curve, t);
+
+    HomogeneousPoint local[NURBS_MAX_DEGREE + 1];
+    NurbsCurve_lift_span(curve, span, local);
+
+    double u[NURBS_MAX_DEGREE];
+    for (int r = 0; r < curve->degree; r++) u[r] = t;
+    return HomogeneousPoint_project(NurbsCurve_blossom(curve, span, local, u));
+}
+
+/* Evaluates the curve at each of the n parameter values in ts, like the bezier batch
+   evaluators. Consecutive values in the same span share the span search and the
+   lifting of its control points, so sorted values are much cheaper than calling
+   NurbsCurve_evaluate for each. */
+void NurbsCurve_evaluate_batch(const NurbsCurve * curve, const double * ts, int n, float * xs, float * ys) {
+    const double * knots = curve->knots;
+
+    HomogeneousPoint local[NURBS_MAX_DEGREE + 1];
+    double u[NURBS_MAX_DEGREE];
+    const int last_span = NurbsCurve_last_span(curve);
+    int span = -1;
+
+    for (int i = 0; i < n; i++) {
+        double t = ts[i];
+
+        bool in_span = span != -1 &&
+            (t >= knots[span] || span == curve->degree) &&
+            (t < knots[span + 1] || span == last_span);
+        if (!in_span) {
+            span = NurbsCurve_find_span(curve, t);
+            NurbsCurve_lift_span(curve, span, local);
+        }
+
+        for (int r = 0; r < curve->degree; r++) u[r] = t;
+        Vec2 p = HomogeneousPoint_project(NurbsCurve_blossom(curve, span, local, u));
+        xs[i] = p.x;
+        ys[i] = p.y;
+    }
+}
+
+// de Casteljau on a homogeneous Bezier curve, optionally also giving the control points of its two halves
+static HomogeneousPoint homogeneous_bezier(const HomogeneousPoint * points, int degree, double t,
+                                           HomogeneousPoint * left, HomogeneousPoint * right) {
+    HomogeneousPoint d[NURBS_MAX_DEGREE + 1];
+    memcpy(d, points, sizeof(HomogeneousPoint) * (degree + 1));
+
+    for (int r = 1; r <= degree; r++) {
+        if (left) left[r - 1] = d[0];
+        if (right) right[degree - r + 1] = d[degree - r + 1];
+        for (int j = 0; j <= degree - r; j++) {
+            d[j] = HomogeneousPoint_lerp(d[j], d[j + 1], t);
+        }
+    }
+    if (left) left[degree] = d[0];
+    if (right) right[0] = d[0];
+    return d[0];
+}
+
+// appends a homogeneous cubic to the document, with its weights scaled so the largest is 1
+static bool CurveDocument_add_homogeneous_cubic(CurveDocument * doc, const HomogeneousPoint cubic[4]) {
+    double max_weight = fmax(fmax(cubic[0].w, cubic[1].w), fmax(cubic[2].w, cubic[3].w));
+
+    Vec2 points[4];
+    float weights[4];
+    for (int i = 0; i < 4; i++) {
+        points[i] = HomogeneousPoint_project(cubic[i]);
+        weights[i] = cubic[i].w / max_weight;
+    }
+    return CurveDocument_add_curve(doc, points, weights);
+}
+
+// splits of a Bezier piece of degree above 3 before giving up on approximating it more closely
+#define NURBS_MAX_SPLIT_DEPTH 12
+
+/* Adds a homogeneous Bezier piece to the document as rational cubics. Pieces of
+   degree 3 or less are degree elevated, so they are exact. Higher degree pieces are
+   approximated with the cubic matching their end points and end tangents, split in
+   half until that cubic is within tolerance of the piece at a few sample points. */
+static bool CurveDocument_add_bezier_piece(CurveDocument * doc, const HomogeneousPoint * piece, int degree,
+                                           float tolerance, int depth) {
+    if (degree <= 3) {
+        HomogeneousPoint cubic[4];
+        memcpy(cubic, piece, sizeof(HomogeneousPoint) * (degree + 1));
+        for (int n = degree; n < 3; n++) {
+            // elevating degree n to n + 1
+            cubic[n + 1] = cubic[n];
+            for (int i = n; i > 0; i--) {
+                cubic[i] = HomogeneousPoint_lerp(cubic[i], cubic[i - 1], (double) i / (n + 1));
+            }
+        }
+        return CurveDocument_add_homogeneous_cubic(doc, cubic);
+    }
+
+    HomogeneousPoint cubic[4] = {
+        piece[0],
+        HomogeneousPoint_lerp(piece[0], piece[1], degree / 3.0),
+        HomogeneousPoint_lerp(piece[degree], piece[degree - 1], degree / 3.0),
+        piece[degree],
+    };
+
+    bool close = cubic[1].w > 0 && cubic[2].w > 0;
+    for (int s = 1; s < 8 && close; s++) {
+        Vec2 a = HomogeneousPoint_project(homogeneous_bezier(piece, degree, s / 8.0, NULL, NULL));
+        Vec2 b = HomogeneousPoint_project(homogeneous_bezier(cubic, 3, s / 8.0, NULL, NULL));
+        close = hypotf(a.x - b.x, a.y - b.y) <= tolerance;
+    }
+    if (close || depth == NURBS_MAX_SPLIT_DEPTH) {
+        return CurveDocument_add_homogeneous_cubic(doc, cubic);
+    }
+
+    HomogeneousPoint left[NURBS_MAX_DEGREE + 1], right[NURBS_MAX_DEGREE + 1];
+    homogeneous_bezier(piece, degree, 0.5, left, right);
+    return CurveDocument_add_bezier_piece(doc, left, degree, tolerance, depth + 1) &&
+        CurveDocument_add_bezier_piece(doc, right, degree, tolerance, depth + 1);
+}
+
+/* Appends a NURBS curve to the document as rational cubics, so it goes through the
+   same path as every other curve. The Bezier piece of each non-empty knot span is
+   extracted by blossoming, which gives the same control points as inserting both
+   ends of the span as knots until they have full multiplicity. Curves of degree
+   above 3 are approximated to within tolerance (in world units). */
+bool CurveDocument_add_nurbs(CurveDocument * doc, const NurbsCurve * curve, float tolerance) {
+    if (!NurbsCurve_check(curve)) return false;
+
+    const int p = curve->degree;
+    for (int span = p; span < curve->count; span++) {
+        double a = curve->knots[span];
+        double b = curve->knots[span + 1];
+        if (a == b) continue;
+
+        HomogeneousPoint local[NURBS_MAX_DEGREE + 1];
+        NurbsCurve_lift_span(curve, span, local);
+
+        // point i of the piece is the blossom at a repeated p - i times and b repeated i times
+        HomogeneousPoint piece[NURBS_MAX_DEGREE + 1];
+        double u[NURBS_MAX_DEGREE];
+        for (int i = 0; i <= p; i++) {
+            for (int r = 0; r < p; r++) u[r] = r < p - i ? a : b;
+            piece[i] = NurbsCurve_blossom(curve, span, local, u);
+        }
+
+        if (!CurveDocument_add_bezier_piece(doc, piece, p, tolerance, 0)) return false;
+    }
+
+    return true;
+}
+
+/* Curve queries: nearest point, rays and curve-curve intersections */
+
+// part of a rational cubic, from t0 to t1 of the whole curve, as homogeneous control points
+typedef struct {
+    HomogeneousPoint points[4];
+    double t0;
+    double t1;
+} CurvePiece;
+
+// deepest subdivision of a curve by the queries, which is well below float precision
+#define CURVE_QUERY_MAX_DEPTH 40
+// two rational cubics cross at most 9 times, unless they overlap
+#define MAX_CURVE_INTERSECTIONS 9
+// crossings this close in t on both curves, as a fraction of the pieces they are found on, are the same one
+#define CURVE_DUPLICATE_T 1e-3
+
+static CurvePiece CurvePiece_make(Vec2 w[4], float r[4]) {
+    CurvePiece piece = { .t0 = 0, .t1 = 1 };
+    for (int i = 0; i < 4; i++) {
+        piece.points[i] = (HomogeneousPoint) { (double) r[i] * w[i].x, (double) r[i] * w[i].y, r[i] };
+    }
+    return piece;
+}
+
+static void CurvePiece_split(const CurvePiece * piece, CurvePiece * left, CurvePiece * right) {
+    homogeneous_bezier(piece->points, 3, 0.5, left->points, right->points);
+    double middle = (piece->t0 + piece->t1) / 2;
+    left->t0 = piece->t0;
+    left->t1 = middle;
+    right->t0 = middle;
+    right->t1 = piece->t1;
+}
+
+// bounds of the projected control points, which contain the piece as long as the weights are positive
+static BoundingBox CurvePiece_bounds(const CurvePiece * piece, Vec2 projected[4]) {
+    for (int i = 0; i < 4; i++) {
+        projected[i] = HomogeneousPoint_project(piece->points[i]);
+    }
+    return get_points_bounds(projected, 4);
+}
+
+static float get_segment_distance(Vec2 p, Vec2 a, Vec2 b, float * u) {
+    Vec2 ab = { b.x - a.x, b.y - a.y };
+    float length_squared = ab.x * ab.x + ab.y * ab.y;
+    float s = length_squared > 0 ? ((p.x - a.x) * ab.x + (p.y - a.y) * ab.y) / length_squared : 0;
+    s = fminf(fmaxf(s, 0), 1);
+    if (u) *u = s;
+    return hypotf(p.x - (a.x + s * ab.x), p.y - (a.y + s * ab.y));
+}
+
+// whether the piece is within tolerance of the chord between its end points
+static bool CurvePiece_flat(const Vec2 projected[4], float tolerance) {
+    return get_segment_distance(projected[1], projected[0], projected[3], NULL) <= tolerance &&
+        get_segment_distance(projected[2], projected[0], projected[3], NULL) <= tolerance;
+}
+
+/* Whether the piece is within tolerance of its chord with its parameter running
+   evenly along the chord, so a point on the chord also gives t. The inner control
+   points have to be near the thirds of the chord and the weights near each other. */
+static bool CurvePiece_linear(const CurvePiece * piece, const Vec2 projected[4], float tolerance) {
+    for (int i = 1; i < 3; i++) {
+        float x = projected[0].x + (projected[3].x - projected[0].x) * i / 3;
+        float y = projected[0].y + (projected[3].y - projected[0].y) * i / 3;
+        if (hypotf(projected[i].x - x, projected[i].y - y) > tolerance) return false;
+    }
+
+    double min_weight = piece->points[0].w;
+    double max_weight = piece->points[0].w;
+    for (int i = 1; i < 4; i++) {
+        min_weight = fmin(min_weight, piece->points[i].w);
+        max_weight = fmax(max_weight, piece->points[i].w);
+    }
+    float length = hypotf(projected[3].x - projected[0].x, projected[3].y - projected[0].y);
+    return (max_weight / min_weight - 1) * length <= tolerance;
+}
+
+float BoundingBox_distance(BoundingBox b, Vec2 p) {
+    float dx = fmaxf(fmaxf(b.min.x - p.x, p.x - b.max.x), 0);
+    float dy = fmaxf(fmaxf(b.min.y - p.y, p.y - b.max.y), 0);
+    return hypotf(dx, dy);
+}
+
+static void CurvePiece_nearest(const CurvePiece * piece, Vec2 p, float tolerance, int depth, CurvePoint * best) {
+    Vec2 projected[4];
+    BoundingBox bounds = CurvePiece_bounds(piece, projected);
+    if (BoundingBox_distance(bounds, p) >= best->distance) return;
+
+    if (depth == CURVE_QUERY_MAX_DEPTH || CurvePiece_flat(projected, tolerance)) {
+        // the closest point on the chord gives the parameter, the point itself is then exact
+        float u;
+        get_segment_distance(p, projected[0], projected[3], &u);
+        Vec2 point = HomogeneousPoint_project(homogeneous_bezier(piece->points, 3, u, NULL, NULL));
+        float distance = hypotf(point.x - p.x, point.y - p.y);
+        if (distance < best->distance) {
+            *best = (CurvePoint) { piece->t0 + u * (piece->t1 - piece->t0), point, distance };
+        }
+        return;
+    }
+
+    CurvePiece halves[2];
+    CurvePiece_split(piece, &halves[0], &halves[1]);
+
+    // the half nearer the start is likely nearer p too when the piece is short, so try it first
+    int first = hypotf(projected[0].x - p.x, projected[0].y - p.y) <= hypotf(projected[3].x - p.x, projected[3].y - p.y)
+        ? 0 : 1;
+    CurvePiece_nearest(&halves[first], p, tolerance, depth + 1, best);
+    CurvePiece_nearest(&halves[1 - first], p, tolerance, depth + 1, best);
+}
+
+/* Finds the point on the curve nearest to p, to within tolerance, by subdividing the
+   curve and skipping every piece whose bounds are further from p than the nearest
+   point so far. Only points closer than max_distance are looked for, and t is -1 if
+   there are none. */
+CurvePoint rational_cubic_bezier_nearest(Vec2 w[4], float r[4], Vec2 p, float max_distance, float tolerance) {
+    CurvePoint best = { -1, p, max_distance };
+    CurvePiece piece = CurvePiece_make(w, r);
+    CurvePiece_nearest(&piece, p, tolerance, 0, &best);
+    return best;
+}
+
+// slab test of the ray from origin along direction against a box
+static bool ray_hits_bounds(Vec2 origin, Vec2 direction, BoundingBox bounds) {
+    double near = 0;
+    double far = INFINITY;
+    const float o[2] = { origin.x, origin.y };
+    const float d[2] = { direction.x, direction.y };
+    const float lo[2] = { bounds.min.x, bounds.min.y };
+    const float hi[2] = { bounds.max.x, bounds.max.y };
+
+    for (int axis = 0; axis < 2; axis++) {
+        if (d[axis] == 0) {
+            if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+            continue;
+        }
+        double s0 = (lo[axis] - o[axis]) / (double) d[axis];
+        double s1 = (hi[axis] - o[axis]) / (double) d[axis];
+        near = fmax(near, fmin(s0, s1));
+        far = fmin(far, fmax(s0, s1));
+    }
+    return near <= far;
+}
+
+/* Finds where the ray from origin along direction crosses the curve, writing the hits
+   in order along the curve and returning how many there are. The distance of each hit
+   from the line of the ray is a linear function of the homogeneous curve, so the
+   crossings are exactly the roots of a cubic, with no subdivision needed. A curve
+   lying along the ray has no hits. */
+int rational_cubic_bezier_ray_intersections(Vec2 w[4], float r[4], Vec2 origin, Vec2 direction, CurvePoint hits[3]) {
+    float length = hypotf(direction.x, direction.y);
+    if (length == 0 || !ray_hits_bounds(origin, direction, get_points_bounds(w, 4))) return 0;
+
+    // signed distances of the weighted control points from the line, scaled by length
+    double v[4];
+    for (int i = 0; i < 4; i++) {
+        v[i] = (double) r[i] * (
+            (double) -direction.y * (w[i].x - origin.x) + (double) direction.x * (w[i].y - origin.y)
+        );
+    }
+
+    double c[4];
+    double roots[4];
+    bezier_power_basis(v, c);
+    int root_count = polynomial_roots_in_unit_interval(c, 3, roots);
+
+    int count = 0;
+    for (int i = 0; i < root_count; i++) {
+        Vec2 point = rational_cubic_bezier(roots[i], w, r);
+        float distance = ((point.x - origin.x) * direction.x + (point.y - origin.y) * direction.y) / length;
+        if (distance < 0) continue;
+        hits[count++] = (CurvePoint) { roots[i], point, distance };
+    }
+    return count;
+}
+
+static void CurvePiece_intersect(const CurvePiece * a, const CurvePiece * b, float tolerance, int depth,
+                                 CurveIntersection * out, int * count) {
+    if (*count == MAX_CURVE_INTERSECTIONS) return;
+
+    Vec2 pa[4], pb[4];
+    if (!BoundingBox_overlaps(CurvePiece_bounds(a, pa), CurvePiece_bounds(b, pb))) return;
+
+    bool flat_a = depth >= CURVE_QUERY_MAX_DEPTH || CurvePiece_linear(a, pa, tolerance);
+    bool flat_b = depth >= CURVE_QUERY_MAX_DEPTH || CurvePiece_linear(b, pb, tolerance);
+
+    if (flat_a && flat_b) {
+        // where the chords cross is close enough, both in position and in t along each piece
+        Vec2 da = { pa[3].x - pa[0].x, pa[3].y - pa[0].y };
+        Vec2 db = { pb[3].x - pb[0].x, pb[3].y - pb[0].y };
+        Vec2 ab = { pb[0].x - pa[0].x, pb[0].y - pa[0].y };
+        Vec2 ab_end = { pb[3].x - pa[0].x, pb[3].y - pa[0].y };
+        double denominator = (double) da.x * db.y - (double) da.y * db.x;
+        double length_a2 = (double) da.x * da.x + (double) da.y * da.y;
+        double length_b2 = (double) db.x * db.x + (double) db.y * db.y;
+
+        double u, v;
+        if (length_a2 > 0 && length_b2 > 0 &&
+            fabs((double) ab.x * da.y - (double) ab.y * da.x) <= tolerance * sqrt(length_a2) &&
+            fabs((double) ab_end.x * da.y - (double) ab_end.y * da.x) <= tolerance * sqrt(length_a2)) {
+            // both ends of b's chord are on a's, so the pieces overlap: take the middle of the overlap
+            double s0 = ((double) ab.x * da.x + (double) ab.y * da.y) / length_a2;
+            double s1 = ((double) ab_end.x * da.x + (double) ab_end.y * da.y) / length_a2;
+            double begin = fmax(0, fmin(s0, s1));
+            double end = fmin(1, fmax(s0, s1));
+            if (!(end > begin)) return;
+            u = (begin + end) / 2;
+            v = s1 != s0 ? (u - s0) / (s1 - s0) : 0.5;
+        } else {
+            if (denominator == 0) return;
+            u = ((double) ab.x * db.y - (double) ab.y * db.x) / denominator;
+            v = ((double) ab.x * da.y - (double) ab.y * da.x) / denominator;
+            if (u < 0 || u > 1 || v < 0 || v > 1) return;
+        }
+
+        Vec2 point = { pa[0].x + u * da.x, pa[0].y + u * da.y };
+        double t_a = a->t0 + u * (a->t1 - a->t0);
+        double t_b = b->t0 + v * (b->t1 - b->t0);
+
+        /* a crossing on the end of a piece is also found by its neighbour, at the same t
+           on both curves up to rounding, while separate crossings can be closer than
+           tolerance in position */
+        for (int i = 0; i < *count; i++) {
+            if (fabs(out[i].t_a - t_a) <= CURVE_DUPLICATE_T * (a->t1 - a->t0) &&
+                fabs(out[i].t_b - t_b) <= CURVE_DUPLICATE_T * (b->t1 - b->t0)) {
+                return;
+            }
+        }
+        out[(*count)++] = (CurveIntersection) { -1, -1, t_a, t_b, point };
+        return;
+    }
+
+    CurvePiece halves[2];
+    if (!flat_a) {
+        CurvePiece_split(a, &halves[0], &halves[1]);
+        CurvePiece_intersect(&halves[0], b, tolerance, depth + 1, out, count);
+        CurvePiece_intersect(&halves[1], b, tolerance, depth + 1, out, count);
+    } else {
+        CurvePiece_split(b, &halves[0], &halves[1]);
+        CurvePiece_intersect(a, &halves[0], tolerance, depth + 1, out, count);
+        CurvePiece_intersect(a, &halves[1], tolerance, depth + 1, out, count);
+    }
+}
+
+/* Finds where two curves cross, to within tolerance, writing up to
+   MAX_CURVE_INTERSECTIONS hits (with the curve indices left as -1) and returning how
+   many there are. Both curves are subdivided until their pieces are straight, dropping
+   every pair of pieces whose bounds don't overlap, so only the pieces near crossings
+   are ever split. Where the curves overlap, each pair of straight pieces lying on each
+   other gives a hit in the middle of their overlap, so the first MAX_CURVE_INTERSECTIONS
+   of those come from the start of the overlap. */
+int rational_cubic_bezier_intersections(Vec2 wa[4], float ra[4], Vec2 wb[4], float rb[4], float tolerance,
+                                        CurveIntersection out[MAX_CURVE_INTERSECTIONS]) {
+    CurvePiece a = CurvePiece_make(wa, ra);
+    CurvePiece b = CurvePiece_make(wb, rb);
+    int count = 0;
+    CurvePiece_intersect(&a, &b, tolerance, 0, out, &count);
+    return count;
+}
+
+/* Finds the curve nearest to p within max_distance, returning -1 if there is none.
+   Chunks, then curves, whose bounds are further away than the nearest curve so far
+   are skipped without being subdivided. */
+int CurveDocument_pick_curve(const CurveDocument * doc, Vec2 p, float max_distance, float tolerance) {
+    int result = -1;
+    float best_distance = max_distance;
+
+    const int chunk_count = CurveDocument_chunk_count(doc);
+    for (int chunk = 0; chunk < chunk_count; chunk++) {
+        if (BoundingBox_distance(doc->chunk_bounds[chunk], p) >= best_distance) continue;
+
+        int end = (chunk + 1) * CURVE_CHUNK_SIZE;
+        if (end > doc->count) end = doc->count;
+        for (int curve = chunk * CURVE_CHUNK_SIZE; curve < end; curve++) {
+            if (BoundingBox_distance(doc->bounds[curve], p) >= best_distance) continue;
+
+            CurvePoint nearest = rational_cubic_bezier_nearest(
+                CurveDocument_points(doc, curve), CurveDocument_weights(doc, curve), p, best_distance, tolerance
+            );
+            if (nearest.t >= 0) {
+                best_distance = nearest.distance;
+                result = curve;
+            }
+        }
+    }
+
+    return result;
+}
+
+// a curve in the sweep of CurveDocument_find_intersections
+typedef struct {
+    float min_x;
+    int curve;
+} SweepEntry;
+
+static int compare_sweep_entries(const void * a, const void * b) {
+    const SweepEntry * x = a;
+    const SweepEntry * y = b;
+    if (x->min_x != y->min_x) return x->min_x < y->min_x ? -1 : 1;
+    return x->curve - y->curve;
+}
+
+/* Finds every crossing between two different curves of the document, to within
+   tolerance, into a buffer grown with reserve_buffer. Returns how many there are, or
+   -1 on failure. Candidate pairs come from sweeping along x: with the curves sorted by
+   the left edge of their bounds, each one only has to be checked against those that
+   start before its right edge, and only pairs whose bounds overlap are subdivided. */
+int CurveDocument_find_intersections(const CurveDocument * doc, float tolerance,
+                                     CurveIntersection ** intersections, int * capacity) {
+    SweepEntry * sweep = malloc(sizeof(SweepEntry) * (doc->count ? doc->count : 1));
+    heap_allocation_count++;
+    if (!sweep) {
+        printf("Could not allocate intersection sweep\n");
+        return -1;
+    }
+    for (int curve = 0; curve < doc->count; curve++) {
+        sweep[curve] = (SweepEntry) { doc->bounds[curve].min.x, curve };
+    }
+    qsort(sweep, doc->count, sizeof(SweepEntry), compare_sweep_entries);
+
+    int count = 0;
+    for (int i = 0; i < doc->count; i++) {
+        const int a = sweep[i].curve;
+        const BoundingBox bounds = doc->bounds[a];
+
+        for (int j = i + 1; j < doc->count && sweep[j].min_x <= bounds.max.x; j++) {
+            const int b = sweep[j].curve;
+            if (!BoundingBox_overlaps(bounds, doc->bounds[b])) continue;
+
+            if (!reserve_buffer((void **) intersections, capacity, count + MAX_CURVE_INTERSECTIONS,
+                                sizeof(CurveIntersection))) {
+                free(sweep);
+                return -1;
+            }
+
+            // always the lower index first, so the results don't depend on the sort
+            const int first = a < b ? a : b;
+            const int second = a < b ? b : a;
+            CurveIntersection * hits = *intersections + count;
+            int hit_count = rational_cubic_bezier_intersections(
+                CurveDocument_points(doc, first), CurveDocument_weights(doc, first),
+                CurveDocument_points(doc, second), CurveDocument_weights(doc, second),
+                tolerance, hits
+            );
+            for (int k = 0; k < hit_count; k++) {
+                hits[k].curve_a = first;
+                hits[k].curve_b = second;
+            }
+            count += hit_count;
+        }
+    }
+
+    free(sweep);
+    return count;
+}
+
+void PolylineCache_cleanup(PolylineCache * cache) {
+    free(cache->entries);
+    free(cache->vertices);
+    free(cache->spare_vertices);
+    *cache = (PolylineCache) {0};
+}
+
+// the slot holding a curve's entry, or the empty slot it would go in
+static PolylineCacheEntry * PolylineCache_find(PolylineCache * cache, int curve) {
+    int mask = cache->entries_capacity - 1;
+    for (int slot = curve & mask;; slot = (slot + 1) & mask) {
+        PolylineCacheEntry * entry = &cache->entries[slot];
+        if (entry->curve == curve || entry->curve == -1) return entry;
+    }
+}
+
+/* Makes sure there is room for another curve_count entries, emptying the cache (and
+   growing it so it isn't emptied every frame) if there isn't. */
+bool PolylineCache_prepare(PolylineCache * cache, int curve_count) {
+    if (cache->entry_count + curve_count <= cache->entries_capacity / 2) return true;
+
+    // reserve_buffer keeps the capacity a power of 2
+    if (!reserve_buffer((void **) &cache->entries, &cache->entries_capacity, curve_count * 4,
+                        sizeof(PolylineCacheEntry))) {
+        return false;
+    }
+
+    for (int i = 0; i < cache->entries_capacity; i++) {
+        cache->entries[i].curve = -1;
+    }
+    cache->entry_count = 0;
+    cache->vertex_count = 0;
+    cache->live_vertex_count = 0;
+
+    return true;
+}
+
+// whether the curve has a polyline for this level, tessellated from the curve as it is now
+PolylineCacheEntry * PolylineCache_get(PolylineCache * cache, const CurveDocument * doc, int curve, int level) {
+    PolylineCacheEntry * entry = PolylineCache_find(cache, curve);
+    bool valid = entry->curve == curve && entry->level == level &&
+        !memcmp(entry->points, CurveDocument_points(doc, curve), sizeof(entry->points)) &&
+        !memcmp(entry->weights, CurveDocument_weights(doc, curve), sizeof(entry->weights));
+    return valid ? entry : NULL;
+}
+
+// updates in place before a polyline is tessellated afresh, so rounding errors can't build up
+#define POLYLINE_MAX_UPDATES 64
+
+/* Brings a curve's polyline for this level up to date in place, rather than having
+   it tessellated again, when a single control point (its position, weight or both)
+   has changed and the curve still needs the same number of segments, as is usual
+   while dragging. Returns NULL if the polyline needs tessellating instead.
+
+   With B the changed point's Bernstein polynomial, the homogeneous numerator N gains
+   (r' P' - r P) B and the denominator D gains (r' - r) B. So each vertex x = N / D
+   becomes (x D + (r' P' - r P) B) / (D + (r' - r) B), with D from the old weights. */
+PolylineCacheEntry * PolylineCache_update(
+    PolylineCache * cache, const CurveDocument * doc, int curve, int level, float tolerance
+) {
+    PolylineCacheEntry * entry = PolylineCache_find(cache, curve);
+    if (entry->curve != curve || entry->level != level || entry->updates == POLYLINE_MAX_UPDATES) return NULL;
+
+    Vec2 * points = CurveDocument_points(doc, curve);
+    float * weights = CurveDocument_weights(doc, curve);
+
+    int changed = -1;
+    for (int i = 0; i < 4; i++) {
+        if (memcmp(&entry->points[i], &points[i], sizeof(Vec2)) || entry->weights[i] != weights[i]) {
+            if (changed != -1) return NULL;
+            changed = i;
+        }
+    }
+    if (changed == -1) return entry;
+
+    const int segments = entry->count;
+    if (rational_cubic_bezier_segment_count(points, weights, tolerance) != segments) return NULL;
+
+    const float * r = entry->weights;
+    double dr = (double) weights[changed] - r[changed];
+    double dx = (double) weights[changed] * points[changed].x - (double) r[changed] * entry->points[changed].x;
+    double dy = (double) weights[changed] * points[changed].y - (double) r[changed] * entry->points[changed].y;
+
+    Vec2 * vertices = cache->vertices + entry->first;
+    for (int k = 1; k < segments; k++) {
+        double t = (double) k / segments;
+        double mt = 1 - t;
+        double b[4] = { mt * mt * mt, 3 * mt * mt * t, 3 * mt * t * t, t * t * t };
+        double d = r[0] * b[0] + r[1] * b[1] + r[2] * b[2] + r[3] * b[3];
+        double inv = 1 / (d + dr * b[changed]);
+        vertices[k] = (Vec2) {
+            (vertices[k].x * d + dx * b[changed]) * inv,
+            (vertices[k].y * d + dy * b[changed]) * inv,
+        };
+    }
+    vertices[0] = points[0];
+    vertices[segments] = points[3];
+
+    memcpy(entry->points, points, sizeof(entry->points));
+    memcpy(entry->weights, weights, sizeof(entry->weights));
+    entry->updates++;
+
+    return entry;
+}
+
+// moves the vertices still in use to the start of the buffer
+static bool PolylineCache_compact(PolylineCache * cache) {
+    if (!reserve_buffer((void **) &cache->spare_vertices, &cache->spare_vertices_capacity,
+                        cache->live_vertex_count, sizeof(Vec2))) {
+        return false;
+    }
+
+    int vertex_count = 0;
+    for (int i = 0; i < cache->entries_capacity; i++) {
+        PolylineCacheEntry * entry = &cache->entries[i];
+        if (entry->curve == -1) continue;
+
+        memcpy(cache->spare_vertices + vertex_count, cache->vertices + entry->first, sizeof(Vec2) * (entry->count + 1));
+        entry->first = vertex_count;
+        vertex_count += entry->count + 1;
+    }
+
+    Vec2 * vertices = cache->vertices;
+    int vertices_capacity = cache->vertices_capacity;
+    cache->vertices = cache->spare_vertices;
+    cache->vertices_capacity = cache->spare_vertices_capacity;
+    cache->spare_vertices = vertices;
+    cache->spare_vertices_capacity = vertices_capacity;
+    cache->vertex_count = vertex_count;
+
+    return true;
+}
+
+/* Stores the polylines just tessellated by the pool, where the pool's curve i is
+   curves[i] in the document. Spans of the same curve are joined back together. */
+bool PolylineCache_store(
+    PolylineCache * cache, const CurveDocument * doc, const TessellationPool * pool, const int * curves, int level
+) {
+    // all the polylines need at most this many vertices (joining spans saves one per join)
+    int new_vertex_count = pool->polyline_starts[pool->item_count];
+
+    if (cache->vertex_count - cache->live_vertex_count > cache->live_vertex_count + new_vertex_count &&
+        !PolylineCache_compact(cache)
+    ) {
+        return false;
+    }
+    if (!reserve_buffer((void **) &cache->vertices, &cache->vertices_capacity,
+                        cache->vertex_count + new_vertex_count, sizeof(Vec2))) {
+        return false;
+    }
+
+    PolylineCacheEntry * entry = NULL;
+    for (int i = 0; i < pool->item_count; i++) {
+        TessellationItem item = pool->items[i];
+        const Vec2 * span = pool->vertices + pool->polyline_starts[i];
+
+        if (item.first == 0) {
+            int curve = curves[item.curve];
+            entry = PolylineCache_find(cache, curve);
+            if (entry->curve == -1) {
+                cache->entry_count++;
+            } else {
+                cache->live_vertex_count -= entry->count + 1;
+            }
+
+            entry->curve = curve;
+            entry->level = level;
+            memcpy(entry->points, CurveDocument_points(doc, curve), sizeof(entry->points));
+            memcpy(entry->weights, CurveDocument_weights(doc, curve), sizeof(entry->weights));
+            entry->first = cache->vertex_count;
+            entry->count = 0;
+            entry->updates = 0;
+
+            cache->vertices[cache->vertex_count++] = span[0];
+            cache->live_vertex_count++;
+        }
+
+        // the first point of a span is the last point of the one before
+        memcpy(cache->vertices + cache->vertex_count, span + 1, sizeof(Vec2) * item.count);
+        cache->vertex_count += item.count;
+        cache->live_vertex_count += item.count;
+        entry->count += item.count;
+    }
+
+    return true;
+}
+
+// Gauss-Legendre nodes on [-1, 1] and their weights, exact for polynomials up to degree 9
+#define GAUSS_LEGENDRE_POINTS 5
+const double GAUSS_LEGENDRE_NODES[GAUSS_LEGENDRE_POINTS] = {
+    -0.9061798459386640, -0.5384693101056831, 0, 0.5384693101056831, 0.9061798459386640,
+};
+const double GAUSS_LEGENDRE_WEIGHTS[GAUSS_LEGENDRE_POINTS] = {
+    0.2369268850561891, 0.4786286704993665, 0.5688888888888889, 0.4786286704993665, 0.2369268850561891,
+};
+
+// intervals an arc length table starts with, before splitting the least accurate ones
+#define ARC_LENGTH_INITIAL_INTERVALS 16
+// how far off an interval of an arc length table can be, relative to the curve's length
+const double ARC_LENGTH_TOLERANCE = 1e-4;
+// speeds evaluated to measure an interval: the quadrature nodes of it and its halves, then its midpoint
+#define ARC_LENGTH_INTERVAL_SPEEDS (GAUSS_LEGENDRE_POINTS * 3 + 1)
+
+// an interval of t while building an arc length table
+typedef struct {
+    double t0;
+    double t1;
+    /* the arc length of the whole interval and of its first half */
+    double length;
+    double left_length;
+    double mid_speed;
+    /* estimate of how far off the interval is, in length */
+    double error;
+} ArcLengthInterval;
+
+static void add_interval_nodes(double t0, double t1, double * ts) {
+    double tm = (t0 + t1) / 2;
+    for (int k = 0; k < GAUSS_LEGENDRE_POINTS; k++) {
+        double x = 0.5 + 0.5 * GAUSS_LEGENDRE_NODES[k];
+        ts[k] = t0 + (t1 - t0) * x;
+        ts[GAUSS_LEGENDRE_POINTS + k] = t0 + (tm - t0) * x;
+        ts[2 * GAUSS_LEGENDRE_POINTS + k] = tm + (t1 - tm) * x;
+    }
+    ts[3 * GAUSS_LEGENDRE_POINTS] = tm;
+}
+
+static double gauss_legendre_sum(const double * speeds, double h) {
+    double sum = 0;
+    for (int k = 0; k < GAUSS_LEGENDRE_POINTS; k++) {
+        sum += GAUSS_LEGENDRE_WEIGHTS[k] * speeds[k];
+    }
+    return sum * h / 2;
+}
+
+/* Where the interpolation between two table points puts the fraction u of the
+   length between them, as a fraction of the t between them. The end slopes are
+   dt/ds = 1 / speed relative to a straight line, limited to 3 to keep it monotonic. */
+static double interpolate_arc_length(double u, double length, double h, double speed0, double speed1) {
+    double m0 = speed0 > 0 ? fmin(length / h / speed0, 3) : 3;
+    double m1 = speed1 > 0 ? fmin(length / h / speed1, 3) : 3;
+
+    double u2 = u * u;
+    double u3 = u2 * u;
+    return (u3 - 2 * u2 + u) * m0 + (3 * u2 - 2 * u3) + (u3 - u2) * m1;
+}
+
+/* Fills in an interval's lengths and error from the speeds at its nodes
+   (add_interval_nodes) and at its ends. The error is the difference between the
+   quadrature over the whole interval and over its two halves, plus how far from the
+   midpoint the interpolation puts the midpoint's arc length. */
+static void ArcLengthInterval_measure(ArcLengthInterval * interval, const double * speeds,
+                                      double speed0, double speed1) {
+    double h = interval->t1 - interval->t0;
+    double whole = gauss_legendre_sum(speeds, h);
+    interval->left_length = gauss_legendre_sum(speeds + GAUSS_LEGENDRE_POINTS, h / 2);
+    interval->length = interval->left_length + gauss_legendre_sum(speeds + 2 * GAUSS_LEGENDRE_POINTS, h / 2);
+    interval->mid_speed = speeds[3 * GAUSS_LEGENDRE_POINTS];
+
+    double u = interval->length > 0 ? interval->left_length / interval->length : 0.5;
+    double mid = interpolate_arc_length(u, interval->length, h, speed0, speed1);
+    interval->error = fabs(whole - interval->length) + fabs(mid - 0.5) * h * interval->mid_speed;
+}
+
+/* Builds the table by integrating the speed of the curve with Gauss-Legendre
+   quadrature, starting with evenly spaced intervals of t and then splitting the one
+   with the largest error until they are all within tolerance or the table is full.
+   The speeds for each round are evaluated in a single batch. */
+void ArcLengthTable_build(ArcLengthTable * table, Vec2 w[4], float r[4]) {
+    ArcLengthInterval intervals[ARC_LENGTH_TABLE_SIZE];
+    double end_speeds[ARC_LENGTH_TABLE_SIZE + 1];
+    double ts[ARC_LENGTH_INITIAL_INTERVALS * ARC_LENGTH_INTERVAL_SPEEDS + ARC_LENGTH_INITIAL_INTERVALS + 1];
+    double speeds[ARC_LENGTH_INITIAL_INTERVALS * ARC_LENGTH_INTERVAL_SPEEDS + ARC_LENGTH_INITIAL_INTERVALS + 1];
+
+    const int node_count = ARC_LENGTH_INITIAL_INTERVALS * ARC_LENGTH_INTERVAL_SPEEDS;
+    for (int i = 0; i < ARC_LENGTH_INITIAL_INTERVALS; i++) {
+        intervals[i].t0 = (double) i / ARC_LENGTH_INITIAL_INTERVALS;
+        intervals[i].t1 = (double) (i + 1) / ARC_LENGTH_INITIAL_INTERVALS;
+        add_interval_nodes(intervals[i].t0, intervals[i].t1, ts + i * ARC_LENGTH_INTERVAL_SPEEDS);
+    }
+    for (int i = 0; i <= ARC_LENGTH_INITIAL_INTERVALS; i++) {
+        ts[node_count + i] = (double) i / ARC_LENGTH_INITIAL_INTERVALS;
+    }
+    rational_cubic_bezier_speed_batch(ts, node_count + ARC_LENGTH_INITIAL_INTERVALS + 1, w, r, speeds);
+
+    double length = 0;
+    memcpy(end_speeds, speeds + node_count, sizeof(double) * (ARC_LENGTH_INITIAL_INTERVALS + 1));
+    for (int i = 0; i < ARC_LENGTH_INITIAL_INTERVALS; i++) {
+        ArcLengthInterval_measure(
+            &intervals[i], speeds + i * ARC_LENGTH_INTERVAL_SPEEDS, end_speeds[i], end_speeds[i + 1]
+        );
+        length += intervals[i].length;
+    }
+
+    int count = ARC_LENGTH_INITIAL_INTERVALS;
+    while (count < ARC_LENGTH_TABLE_SIZE) {
+        int worst = 0;
+        for (int i = 1; i < count; i++) {
+            if (intervals[i].error > intervals[worst].error) worst = i;
+        }
+        if (intervals[worst].error <= ARC_LENGTH_TOLERANCE * length) break;
+
+        // split the worst interval in place, at its midpoint
+        ArcLengthInterval whole = intervals[worst];
+        memmove(&intervals[worst + 1], &intervals[worst], sizeof(ArcLengthInterval) * (count - worst));
+        memmove(&end_speeds[worst + 1], &end_speeds[worst], sizeof(double) * (count + 1 - worst));
+        count++;
+
+        double tm = (whole.t0 + whole.t1) / 2;
+        intervals[worst].t0 = whole.t0;
+        intervals[worst].t1 = tm;
+        intervals[worst + 1].t0 = tm;
+        intervals[worst + 1].t1 = whole.t1;
+        end_speeds[worst + 1] = whole.mid_speed;
+
+        add_interval_nodes(whole.t0, tm, ts);
+        add_interval_nodes(tm, whole.t1, ts + ARC_LENGTH_INTERVAL_SPEEDS);
+        rational_cubic_bezier_speed_batch(ts, 2 * ARC_LENGTH_INTERVAL_SPEEDS, w, r, speeds);
+        for (int k = 0; k < 2; k++) {
+            ArcLengthInterval_measure(
+                &intervals[worst + k], speeds + k * ARC_LENGTH_INTERVAL_SPEEDS,
+                end_speeds[worst + k], end_speeds[worst + k + 1]
+            );
+        }
+        length += intervals[worst].length + intervals[worst + 1].length - whole.length;
+    }
+
+    table->count = count;
+    table->ts[0] = 0;
+    table->lengths[0] = 0;
+    double total = 0;
+    for (int i = 0; i < count; i++) {
+        total += intervals[i].length;
+        table->ts[i + 1] = intervals[i].t1;
+        table->lengths[i + 1] = total;
+    }
+    for (int i = 0; i <= count; i++) {
+        table->speeds[i] = end_speeds[i];
+    }
+}
+
+float ArcLengthTable_length(const ArcLengthTable * table) {
+    return table->lengths[table->count];
+}
+
+// the t at which the arc length from the start is s (clamped to the curve), interpolated from the table
+double ArcLengthTable_t_at(const ArcLengthTable * table, float s) {
+    if (s <= 0) return 0;
+    if (s >= table->lengths[table->count]) return 1;
+
+    // the last point i with lengths[i] <= s
+    int lo = 0;
+    int hi = table->count;
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (table->lengths[mid] <= s) lo = mid; else hi = mid;
+    }
+
+    double h = table->ts[lo + 1] - table->ts[lo];
+    double interval_length = table->lengths[lo + 1] - table->lengths[lo];
+    if (interval_length <= 0) return table->ts[lo];
+
+    double u = (s - table->lengths[lo]) / interval_length;
+    return table->ts[lo] + h * interpolate_arc_length(
+        u, interval_length, h, table->speeds[lo], table->speeds[lo + 1]
+    );
+}
+
+// how many points spacing apart fit along the curve, including both its start and the last one
+int ArcLengthTable_sample_count(const ArcLengthTable * table, float spacing) {
+    assert(spacing > 0);
+    return (int) (ArcLengthTable_length(table) / spacing) + 1;
+}
+
+/* Writes count points spacing apart along the curve, from its start, looking up
+   each t in the table and then evaluating them with the batch evaluator */
+void rational_cubic_bezier_sample_uniform(const ArcLengthTable * table, Vec2 w[4], float r[4], float spacing,
+                                          int count, Vec2 * out) {
+    double ts[64];
+    float xs[64];
+    float ys[64];
+
+    for (int i = 0; i < count; i += 64) {
+        int n = count - i < 64 ? count - i : 64;
+        for (int k = 0; k < n; k++) {
+            ts[k] = ArcLengthTable_t_at(table, (i + k) * spacing);
+        }
+        rational_cubic_bezier_batch(ts, n, w, r, xs, ys);
+        for (int k = 0; k < n; k++) {
+            out[i + k] = (Vec2) { xs[k], ys[k] };
+        }
+    }
+}
+
+void ArcLengthCache_cleanup(ArcLengthCache * cache) {
+    free(cache->entries);
+    *cache = (ArcLengthCache) {0};
+}
+
+static ArcLengthCacheEntry * ArcLengthCache_find(ArcLengthCache * cache, int curve) {
+    int mask = cache->entries_capacity - 1;
+    for (int slot = curve & mask;; slot = (slot + 1) & mask) {
+        ArcLengthCacheEntry * entry = &cache->entries[slot];
+        if (entry->curve == curve || entry->curve == -1) return entry;
+    }
+}
+
+// makes room for curve_count more tables, emptying the cache if it would get over half full
+bool ArcLengthCache_prepare(ArcLengthCache * cache, int curve_count) {
+    if (cache->entry_count + curve_count <= cache->entries_capacity / 2) return true;
+
+    // reserve_buffer keeps the capacity a power of 2
+    if (!reserve_buffer((void **) &cache->entries, &cache->entries_capacity, curve_count * 4,
+                        sizeof(ArcLengthCacheEntry))) {
+        return false;
+    }
+
+    for (int i = 0; i < cache->entries_capacity; i++) {
+        cache->entries[i].curve = -1;
+    }
+    cache->entry_count = 0;
+
+    return true;
+}
+
+/* Returns the curve's arc length table, building it if the curve is new or has
+   changed since it was built. Returns NULL if the cache couldn't grow. The table is
+   only valid until a call that has to empty the cache. */
+const ArcLengthTable * ArcLengthCache_get(ArcLengthCache * cache, const CurveDocument * doc, int curve) {
+    if (!ArcLengthCache_prepare(cache, 1)) return NULL;
+
+    Vec2 * points = CurveDocument_points(doc, curve);
+    float * weights = CurveDocument_weights(doc, curve);
+
+    ArcLengthCacheEntry * entry = ArcLengthCache_find(cache, curve);
+    bool valid = entry->curve == curve &&
+        !memcmp(entry->points, points, sizeof(entry->points)) &&
+        !memcmp(entry->weights, weights, sizeof(entry->weights));
+    if (valid) return &entry->table;
+
+    if (entry->curve == -1) cache->entry_count++;
+    entry->curve = curve;
+    memcpy(entry->points, points, sizeof(entry->points));
+    memcpy(entry->weights, weights, sizeof(entry->weights));
+    ArcLengthTable_build(&entry->table, points, weights);
+    return &entry->table;
+}
+
+/* Samples each of the given curves every spacing along its length, into a buffer
+   grown with reserve_buffer: curve i's points are points[starts[i]] up to
+   points[starts[i + 1]], so starts needs count + 1 entries. Returns false if the
+   buffer or the cache couldn't grow. */
+bool ArcLengthCache_sample_uniform(ArcLengthCache * cache, const CurveDocument * doc, const int * curves, int count,
+                                   float spacing, Vec2 ** points, int * capacity, int * starts) {
+    // so the cache isn't emptied partway through
+    if (!ArcLengthCache_prepare(cache, count)) return false;
+
+    starts[0] = 0;
+    for (int i = 0; i < count; i++) {
+        const ArcLengthTable * table = ArcLengthCache_get(cache, doc, curves[i]);
+        if (!table) return false;
+
+        int sample_count = ArcLengthTable_sample_count(table, spacing);
+        if (!reserve_buffer((void **) points, capacity, starts[i] + sample_count, sizeof(Vec2))) return false;
+
+        rational_cubic_bezier_sample_uniform(
+            table, CurveDocument_points(doc, curves[i]), CurveDocument_weights(doc, curves[i]), spacing,
+            sample_count, *points + starts[i]
+        );
+        starts[i + 1] = starts[i] + sample_count;
+    }
+    return true;
+}
+
+void PointGrid_cleanup(PointGrid * grid) {
+    free(grid->cell_start);
+    free(grid->entries);
+    *grid = (PointGrid) {0};
+}
+
+void PointGrid_get_cell(const PointGrid * grid, Vec2 p, int * column, int * row) {
+    int x = (p.x - grid->origin.x) / grid->cell_size;
+    int y = (p.y - grid->origin.y) / grid->cell_size;
+    *column = x < 0 ? 0 : x >= grid->columns ? grid->columns - 1 : x;
+    *row = y < 0 ? 0 : y >= grid->rows ? grid->rows - 1 : y;
+}
+
+// (re)builds the grid from scratch, sized to hold about 2 points per cell
+bool PointGrid_build(PointGrid * grid, const CurveDocument * doc) {
+    int point_count = doc->count * 4;
+
+    Vec2 min = { 0, 0 };
+    Vec2 max = { 0, 0 };
+    for (int i = 0; i < point_count; i++) {
+        Vec2 p = doc->points[i];
+        if (i == 0 || p.x < min.x) min.x = p.x;
+        if (i == 0 || p.y < min.y) min.y = p.y;
+        if (i == 0 || p.x > max.x) max.x = p.x;
+        if (i == 0 || p.y > max.y) max.y = p.y;
+    }
+
+    float width = max.x - min.x;
+    float height = max.y - min.y;
+    int target_cells = point_count / 2 > 1 ? point_count / 2 : 1;
+
+    // the second bound stops long thin documents from getting too many cells along one axis
+    float cell_size = sqrtf(width * height / target_cells);
+    float min_cell_size = fmaxf(width, height) / target_cells;
+    if (cell_size < min_cell_size) cell_size = min_cell_size;
+    if (!(cell_size > 0)) cell_size = 1;
+
+    /* the new arrays only replace the old ones once both are allocated, so a failed
+       build leaves the old grid as it was, with arrays that still match its size */
+    int columns = width / cell_size + 1;
+    int rows = height / cell_size + 1;
+    int cell_count = columns * rows;
+    int * cell_start = malloc(sizeof(int) * (cell_count + 1));
+    int * entries = malloc(sizeof(int) * (point_count > 0 ? point_count : 1));
+    if (!cell_start || !entries) {
+        printf("Could not allocate point grid with %d cells\n", cell_count);
+        free(cell_start);
+        free(entries);
+        return false;
+    }
+    free(grid->cell_start);
+    free(grid->entries);
+    grid->cell_start = cell_start;
+    grid->entries = entries;
+
+    grid->origin = min;
+    grid->cell_size = cell_size;
+    grid->columns = columns;
+    grid->rows = rows;
+
+    /* counting sort of point indices by cell: count into cell_start[c + 1], turn the
+       counts into starting offsets, then place each point while advancing its cell's
+       offset (which leaves cell_start shifted down by one cell) */
+    memset(cell_start, 0, sizeof(int) * (cell_count + 1));
+    for (int i = 0; i < point_count; i++) {
+        int column, row;
+        PointGrid_get_cell(grid, doc->points[i], &column, &row);
+        cell_start[row * grid->columns + column + 1]++;
+    }
+    for (int c = 0; c < cell_count; c++) {
+        cell_start[c + 1] += cell_start[c];
+    }
+    for (int i = 0; i < point_count; i++) {
+        int column, row;
+        PointGrid_get_cell(grid, doc->points[i], &column, &row);
+        entries[cell_start[row * grid->columns + column]++] = i;
+    }
+    memmove(cell_start + 1, cell_start, sizeof(int) * cell_count);
+    cell_start[0] = 0;
+
+    grid->stale = false;
+
+    return true;
+}
+
+Vec2 Vec2_add(Vec2 a, Vec2 b) {
+    return (Vec2) { a.x + b.x, a.y + b.y };
+}
+
+Vec2 Vec2_sub(Vec2 a, Vec2 b) {
+    return (Vec2) { a.x - b.x, a.y - b.y };
+}
+
+// scale a point by a scalar
+Vec2 Vec2_scale(Vec2 p, float s) {
+    return (Vec2) { p.x * s, p.y * s };
+}
+
+// scale a point by the reciprocal of a scalar
+Vec2 Vec2_iscale(Vec2 p, float s) {
+    return (Vec2) { p.x / s, p.y / s };
+}
+
+// each zoom step scales the view by this much
+#define VIEW_SCALE_BASE 1.1
+
+float get_actual_scale(float log_scale) {
+    return pow(VIEW_SCALE_BASE, log_scale);
+}
+
+// moves and zooms the view, working out the scale factors for the new zoom level
+void Viewport_set(Viewport * view, Vec2 center, float log_scale) {
+    view->center = center;
+    view->log_scale = log_scale;
+    view->scale = get_actual_scale(log_scale);
+    view->inv_scale = 1 / view->scale;
+}
+
+void Viewport_resize(Viewport * view, int width, int height) {
+    view->width = width;
+    view->height = height;
+    view->half_size = (Vec2) { width / 2, height / 2 };
+}
+
+Vec2 Viewport_world_to_view(const Viewport * view, Vec2 world_pos) {
+    return (Vec2) {
+        (world_pos.x - view->center.x) * view->inv_scale + view->half_size.x,
+        (world_pos.y - view->center.y) * view->inv_scale + view->half_size.y,
+    };
+}
+
+Vec2 Viewport_view_to_world(const Viewport * view, Vec2 view_pos) {
+    return (Vec2) {
+        (view_pos.x - view->half_size.x) * view->scale + view->center.x,
+        (view_pos.y - view->half_size.y) * view->scale + view->center.y,
+    };
+}
+
+/* Batch version of Viewport_world_to_view, transforming n points into out (which
+   can be the same array). Like the bezier batch kernels, the SIMD kernels do the
+   same single precision operations as the single point version, so each point ends
+   up exactly where Viewport_world_to_view would put it. The kernels are with the other
+   batch kernels, so they are selected along with them. */
+void Viewport_world_to_view_batch(const Viewport * view, const Vec2 * world, int n, Vec2 * out) {
+    for (int i = bezier_batch_kernels.world_to_view(view, world, n, out); i < n; i++) {
+        out[i] = Viewport_world_to_view(view, world[i]);
+    }
+}
+
+/* Flattens a closed path of count rational cubics joined end to end (4 control points
+   and weights each, in world space) into a polygon in view space for Canvas_fill_path,
+   appending its points to a buffer grown with reserve_buffer from *used on. Each curve
+   is split into as many segments as keep it within CURVE_TOLERANCE pixels, and its end
+   point is left to the next curve (or the polygon closing). Returns false if the
+   buffer couldn't grow. */
+bool rational_cubic_path_flatten(const Viewport * view, Vec2 * points, float * weights, int count,
+                                 Vec2 ** out, int * capacity, int * used) {
+    const float tolerance = CURVE_TOLERANCE * view->scale;
+    Vec2 curve_points[MAX_CURVE_SEGMENTS + 1];
+
+    for (int c = 0; c < count; c++) {
+        Vec2 * w = points + 4 * c;
+        float * r = weights + 4 * c;
+        int segments = rational_cubic_bezier_segment_count(w, r, tolerance);
+        if (!reserve_buffer((void **) out, capacity, *used + segments, sizeof(Vec2))) return false;
+
+        rational_cubic_bezier_tessellate(w, r, segments, curve_points);
+        Viewport_world_to_view_batch(view, curve_points, segments, *out + *used);
+        *used += segments;
+    }
+    return true;
+}
+
+/* Copies the interaction state into the back snapshot and makes it the latest one,
+   for render() to pick up, waking the render thread. Called with the mutex held (or
+   before any events are handled), so only one thread publishes at a time. */
+bool RenderState_publish(RenderState * state) {
+    PROFILE_BEGIN(PROFILE_STAGE_PUBLISH);
+    SceneSnapshot * back = &state->snapshots[state->snapshot_back];
+
+    // the document is only copied when it has changed since this snapshot last held it
+    if (back->doc.version != state->doc.version || back->doc.count != state->doc.count) {
+        if (!CurveDocument_copy(&back->doc, &state->doc)) return false;
+    }
+    back->active_curve = state->active_curve;
+    back->view = state->view;
+
+    int previous = SDL_AtomicSet(&state->snapshot_middle, state->snapshot_back | SNAPSHOT_FRESH);
+    state->snapshot_back = previous & ~SNAPSHOT_FRESH;
+    state->dirty = 0;
+    if (SDL_CondSignal(state->published)) assert(0);
+
+    PROFILE_END(PROFILE_STAGE_PUBLISH);
+    return true;
+}
+
+// whether a published snapshot is still waiting to be drawn
+bool RenderState_frame_pending(RenderState * state) {
+    return SDL_AtomicGet(&state->snapshot_middle) & SNAPSHOT_FRESH;
+}
+
+/* TODO may want to change convention to returning true on error
+   This would apply to RenderState_init and render
+   Means we can change the return values in a consistent manner
+*/
+bool RenderState_init(RenderState * state, Canvas canvas, TTF_Font * font) {
+    assert(!state->mutex);
+    assert(!canvas.renderer != !canvas.software);
+
+    int win_width = INITIAL_SCREEN_WIDTH;
+    int win_height = INITIAL_SCREEN_HEIGHT;
+
+    Vec2 points[4] = {
+        { -win_width / 4, -win_height / 4 },
+        { -win_width / 4, win_height / 4 },
+        { win_width / 4, win_height / 4 },
+        { win_width / 4, -win_height / 4 },
+    };
+    float weights[4];
+
+    for (int i = 0; i < 4; i++) {
+        weights[i] = 1.00f;
+        state->sliders_label_value[i] = NAN; // forces the label to be formatted on first render
+    }
+
+    if (!CurveDocument_init(&state->doc) || !CurveDocument_add_curve(&state->doc, points, weights)) {
+        return false;
+    }
+    state->active_curve = 0;
+
+    if (!PointGrid_build(&state->grid, &state->doc)) {
+        return false;
+    }
+
+    Viewport_set(&state->view, (Vec2) { 0, 0 }, 0);
+
+    // a software canvas has a fixed size
+    Viewport_resize(
+        &state->view,
+        canvas.software ? canvas.software->width : win_width,
+        canvas.software ? canvas.software->height : win_height
+    );
+
+    state->selected = MOUSE_SELECTED_NONE;
+
+    state->dirty = DIRTY_ALL;
+
+    state->canvas = canvas;
+    state->font = font;
+
+    if (!GlyphAtlas_init(&state->atlas, canvas.renderer, font)) {
+        return false;
+    }
+    state->label_width = get_atlas_text_width(&state->atlas, "0.00");
+
+    FrameArena_init(&state->frame_arena);
+    if (!TessellationPool_init(&state->tessellation)) {
+        return false;
+    }
+
+    state->mutex = SDL_CreateMutex();
+    state->published = SDL_CreateCond();
+    if (!state->mutex || !state->published) {
+        printf("Could not create mutex: %s\n", SDL_GetError());
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        CurveDocument_init(&state->snapshots[i].doc);
+    }
+    state->snapshot_back = 0;
+    state->snapshot_front = 1;
+    SDL_AtomicSet(&state->snapshot_middle, 2);
+
+    return RenderState_publish(state);
+}
+
+/* Replaces the document with a mapped scene file, fitting the view to it. Called
+   before any events are handled, as the old document may not be mapped. */
+bool RenderState_load_scene(RenderState * state, const char * path) {
+    CurveDocument doc;
+    if (!CurveDocument_map(&doc, path)) return false;
+    if (doc.count == 0) {
+        printf("%s has no curves to show\n", path);
+        CurveDocument_cleanup(&doc);
+        return false;
+    }
+
+    if (SDL_LockMutex(state->mutex)) assert(0);
+
+    assert(!state->doc.mapping);
+    doc.version = state->doc.version + 1;
+    CurveDocument_cleanup(&state->doc);
+    state->doc = doc;
+    state->active_curve = 0;
+    // only built once it is needed for picking, as it has to go through every point
+    state->grid.stale = true;
+
+    // the chunk index is enough to find the bounds of the whole scene
+    BoundingBox bounds = doc.chunk_bounds[0];
+    for (int k = 1; k < CurveDocument_chunk_count(&doc); k++) {
+        bounds = BoundingBox_union(bounds, doc.chunk_bounds[k]);
+    }
+    Vec2 center = { (bounds.min.x + bounds.max.x) / 2, (bounds.min.y + bounds.max.y) / 2 };
+
+    // smallest zoom step with the whole scene (and a bit of margin) on screen
+    double scale = fmax(
+        (bounds.max.x - bounds.min.x) / state->view.width, (bounds.max.y - bounds.min.y) / state->view.height
+    ) * 1.1;
+    Viewport_set(&state->view, center, scale > 0 ? ceil(log(scale) / log(VIEW_SCALE_BASE)) : 0);
+
+    state->dirty = DIRTY_ALL;
+    bool success = RenderState_publish(state);
+
+    if (SDL_UnlockMutex(state->mutex)) assert(0);
+
+    return success;
+}
+
+// square drawn for a point, submitted in batches with SDL_RenderFillRects
+SDL_Rect get_point_rect(Vec2 p) {
+    return (SDL_Rect) { p.x - POINT_SIZE / 2, p.y - POINT_SIZE / 2, POINT_SIZE, POINT_SIZE };
+}
+
+bool check_mouse_on_point(int x, int y, Vec2 p) {
+    return x < p.x + POINT_SIZE / 2 && x >= p.x - POINT_SIZE / 2 && y < p.y + POINT_SIZE / 2 && y >= p.y - POINT_SIZE / 2;
+}
+
+/* Returns the index (4 * curve + point) of the first control point under the mouse,
+   or -1 if there is none. Only the grid cells overlapping the world space square a
+   point could be drawn in around the mouse are searched. */
+int PointGrid_pick(const PointGrid * grid, const CurveDocument * doc, int mouse_x, int mouse_y,
+                   const Viewport * view) {
+    if (doc->count == 0) return -1;
+
+    // extra pixel accounts for rounding of the point squares
+    float reach = POINT_SIZE / 2 + 1;
+    Vec2 world_min = Viewport_view_to_world(view, (Vec2) { mouse_x - reach, mouse_y - reach });
+    Vec2 world_max = Viewport_view_to_world(view, (Vec2) { mouse_x + reach, mouse_y + reach });
+
+    int column_min, row_min, column_max, row_max;
+    PointGrid_get_cell(grid, world_min, &column_min, &row_min);
+    PointGrid_get_cell(grid, world_max, &column_max, &row_max);
+
+    int result = -1;
+    for (int row = row_min; row <= row_max; row++) {
+        for (int column = column_min; column <= column_max; column++) {
+            int cell = row * grid->columns + column;
+            for (int e = grid->cell_start[cell]; e < grid->cell_start[cell + 1]; e++) {
+                int index = grid->entries[e];
+                if (result != -1 && index > result) continue;
+
+                Vec2 point_position = Viewport_world_to_view(view, doc->points[index]);
+                if (check_mouse_on_point(mouse_x, mouse_y, point_position)) {
+                    result = index;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+int slider_value_to_x(float value, int x1, int x2) {
+    assert(SLIDER_MAX > SLIDER_MIN);
+    assert(x2 > x1);
+    return x1 + (value - SLIDER_MIN) * (x2 - x1) / (SLIDER_MAX - SLIDER_MIN);
+}
+
+float slider_x_to_value(int x, int x1, int x2) {
+    assert(SLIDER_MAX > SLIDER_MIN);
+    assert(x2 > x1);
+    assert(x1 <= x && x <= x2);
+    return SLIDER_MIN + (x - x1) * (SLIDER_MAX - SLIDER_MIN) / (x2 - x1);
+}
+
+SliderLayout get_slider_layout(int win_width, int win_height, int text_width) {
+    SliderLayout layout;
+
+    const int slider_box_outer_padding = 20;
+    const int slider_box_width = win_width / 2 - slider_box_outer_padding;
+    const int slider_box_height = win_height / 6;
+    layout.box = (SDL_Rect) {
+        win_width - slider_box_width - slider_box_outer_padding,
+        win_height - slider_box_height - slider_box_outer_padding,
+        slider_box_width,
+        slider_box_height,
+    };
+
+    layout.inner_padding = slider_box_height / 5;
+
+    for (int i = 0; i < 4; i++) {
+        // calculating in full here to avoid integer rounding errors, subtracting 1 accounts for line height (1 pixel)
+        int current_row_offset = (slider_box_height - layout.inner_padding * 2 - 1) * i / 3;
+        layout.y[i] = layout.box.y + layout.inner_padding + current_row_offset;
+    }
+
+    int line_width = slider_box_width - layout.inner_padding * 3 - text_width;
+    layout.x1 = layout.box.x + layout.inner_padding;
+    layout.x2 = layout.x1 + line_width;
+    // handle window resized too small
+    if (layout.x2 <= layout.x1) layout.x2 = layout.x1 + 1;
+
+    return layout;
+}
+
+bool SoftwareRenderer_add_command(SoftwareRenderer * software, SoftwareCommandType type, int first, int count) {
+    if (!reserve_buffer((void **) &software->commands, &software->commands_capacity,
+                        software->command_count + 1, sizeof(SoftwareCommand))) {
+        return false;
+    }
+    software->commands[software->command_count++] = (SoftwareCommand) { type, software->color, first, count };
+    return true;
+}
+
+// records count polylines sharing one vertex array, as laid out for Canvas_draw_polylines
+bool SoftwareRenderer_add_polylines(SoftwareRenderer * software, const Vec2 * points, const int * starts, int count) {
+    int vertex_count = starts[count] - starts[0];
+    if (!reserve_buffer((void **) &software->vertices, &software->vertices_capacity,
+                        software->vertex_count + vertex_count, sizeof(Vec2))) {
+        return false;
+    }
+    memcpy(software->vertices + software->vertex_count, points + starts[0], sizeof(Vec2) * vertex_count);
+
+    int offset = software->vertex_count - starts[0];
+    software->vertex_count += vertex_count;
+    for (int i = 0; i < count; i++) {
+        if (!SoftwareRenderer_add_command(software, SOFTWARE_POLYLINE, starts[i] + offset, starts[i + 1] - starts[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SoftwareRenderer_add_rects(SoftwareRenderer * software, SoftwareCommandType type, const SDL_Rect * rects, int count) {
+    if (!reserve_buffer((void **) &software->rects, &software->rects_capacity,
+                        software->rect_count + count, sizeof(SDL_Rect))) {
+        return false;
+    }
+    memcpy(software->rects + software->rect_count, rects, sizeof(SDL_Rect) * count);
+    software->rect_count += count;
+    return SoftwareRenderer_add_command(software, type, software->rect_count - count, count);
+}
+
+/* Adds the parts of the edge from a to b that are left of width to edges, returning
+   how many were added (at most 3). Parts left of 0 are moved onto x = 0, where they
+   still cover every pixel to their right, and parts right of width are dropped, as
+   they cover no pixels at all. */
+static int clip_fill_edge(Vec2 a, Vec2 b, float width, FillEdge * edges) {
+    if (a.y == b.y) return 0;
+
+    // most edges need no clipping
+    if (a.x >= 0 && b.x >= 0 && a.x <= width && b.x <= width) {
+        edges[0] = a.y < b.y
+            ? (FillEdge) { a.x, a.y, b.x, b.y, 1 }
+            : (FillEdge) { b.x, b.y, a.x, a.y, -1 };
+        return 1;
+    }
+
+    // split where the edge crosses x = 0 and x = width
+    float splits[4] = { 0 };
+    int split_count = 1;
+    const float bounds[2] = { 0, width };
+    for (int k = 0; k < 2; k++) {
+        float t = (bounds[k] - a.x) / (b.x - a.x);
+        if (t > 0 && t < 1) splits[split_count++] = t;
+    }
+    if (split_count == 3 && splits[2] < splits[1]) {
+        float t = splits[1];
+        splits[1] = splits[2];
+        splits[2] = t;
+    }
+    splits[split_count] = 1;
+
+    int count = 0;
+    for (int k = 0; k < split_count; k++) {
+        float t0 = splits[k];
+        float t1 = splits[k + 1];
+        Vec2 p0 = { a.x + (b.x - a.x) * t0, a.y + (b.y - a.y) * t0 };
+        Vec2 p1 = k + 1 == split_count ? b : (Vec2) { a.x + (b.x - a.x) * t1, a.y + (b.y - a.y) * t1 };
+        if (p0.y == p1.y) continue;
+
+        float mid = (p0.x + p1.x) / 2;
+        if (mid >= width) continue;
+        p0.x = mid < 0 ? 0 : fminf(fmaxf(p0.x, 0), width);
+        p1.x = mid < 0 ? 0 : fminf(fmaxf(p1.x, 0), width);
+
+        edges[count++] = p0.y < p1.y
+            ? (FillEdge) { p0.x, p0.y, p1.x, p1.y, 1 }
+            : (FillEdge) { p1.x, p1.y, p0.x, p0.y, -1 };
+    }
+    return count;
+}
+
+// the bands of rows the edge crosses, which has to reach the framebuffer's rows
+static void get_fill_edge_bands(const FillEdge * edge, int height, int * first, int * last) {
+    // both are positive here, so converting to int rounds down
+    int y0 = edge->y0 > 0 ? (int) edge->y0 : 0;
+    int y1 = edge->y1 < height ? (int) edge->y1 + ((int) edge->y1 < edge->y1) : height;
+    *first = y0 / SOFTWARE_BAND_HEIGHT;
+    *last = (y1 - 1) / SOFTWARE_BAND_HEIGHT;
+}
+
+/* Records a filled path, polygon i being points[starts[i]] up to points[starts[i + 1]]
+   and closed back to its first point. Only the points are copied here: the edges are
+   clipped and binned by the raster threads when the frame is presented, so all this
+   has to do is split them into chunks and make room for what those will need. */
+bool SoftwareRenderer_add_fill(SoftwareRenderer * software, const Vec2 * points, const int * starts, int count,
+                               FillRule rule) {
+    const int band_count = (software->height + SOFTWARE_BAND_HEIGHT - 1) / SOFTWARE_BAND_HEIGHT;
+    const int point_count = starts[count] - starts[0];
+    const int chunk_count = (point_count + FILL_CHUNK_EDGES - 1) / FILL_CHUNK_EDGES;
+
+    if (software->accumulation_threads < software->thread_count) {
+        free(software->accumulation);
+        software->accumulation_threads = 0;
+        software->accumulation = calloc(
+            (size_t) software->thread_count * SOFTWARE_BAND_HEIGHT * (software->width + FILL_ROW_PADDING),
+            sizeof(float)
+        );
+        if (!software->accumulation) {
+            printf("Could not allocate coverage rows for %d threads\n", software->thread_count);
+            return false;
+        }
+        software->accumulation_threads = software->thread_count;
+    }
+
+    if (!reserve_buffer((void **) &software->fills, &software->fills_capacity,
+                        software->fill_count + 1, sizeof(SoftwareFill)) ||
+        !reserve_buffer((void **) &software->fill_points, &software->fill_points_capacity,
+                        software->fill_point_count + point_count, sizeof(Vec2)) ||
+        !reserve_buffer((void **) &software->fill_starts, &software->fill_starts_capacity,
+                        software->fill_start_count + count + 1, sizeof(int)) ||
+        !reserve_buffer((void **) &software->fill_chunks, &software->fill_chunks_capacity,
+                        software->fill_chunk_count + chunk_count, sizeof(SoftwareFillChunk)) ||
+        !reserve_buffer((void **) &software->fill_chunk_bands, &software->fill_chunk_bands_capacity,
+                        (software->fill_chunk_count + chunk_count) * band_count, sizeof(int)) ||
+        !reserve_buffer((void **) &software->fill_edges, &software->fill_edges_capacity,
+                        3 * (software->fill_point_count + point_count), sizeof(FillEdge)) ||
+        !reserve_buffer((void **) &software->fill_band_starts, &software->fill_band_starts_capacity,
+                        software->fill_band_start_count + band_count + 1, sizeof(int))) {
+        return false;
+    }
+
+    const int first_point = software->fill_point_count;
+    memcpy(software->fill_points + first_point, points + starts[0], sizeof(Vec2) * point_count);
+    int * fill_starts = software->fill_starts + software->fill_start_count;
+    for (int i = 0; i <= count; i++) {
+        fill_starts[i] = starts[i] - starts[0] + first_point;
+    }
+
+    int polygon = 0;
+    for (int c = 0; c < chunk_count; c++) {
+        int first = first_point + c * FILL_CHUNK_EDGES;
+        int end = first + FILL_CHUNK_EDGES < first_point + point_count ? first + FILL_CHUNK_EDGES : first_point + point_count;
+        while (fill_starts[polygon + 1] <= first) polygon++;
+        software->fill_chunks[software->fill_chunk_count + c] = (SoftwareFillChunk) {
+            software->fill_count, software->fill_start_count + polygon, first, end, 0
+        };
+    }
+
+    software->fills[software->fill_count++] = (SoftwareFill) {
+        rule, software->fill_start_count, count, software->fill_chunk_count, chunk_count, software->fill_band_start_count
+    };
+    software->fill_point_count += point_count;
+    software->fill_start_count += count + 1;
+    software->fill_chunk_count += chunk_count;
+    software->fill_band_start_count += band_count + 1;
+    return SoftwareRenderer_add_command(software, SOFTWARE_FILL, software->fill_count - 1, 1);
+}
+
+// clips a chunk of a filled path's edges, counting how many of them cross each band
+static void SoftwareRenderer_clip_fill_chunk(SoftwareRenderer * software, int c) {
+    const int band_count = (software->height + SOFTWARE_BAND_HEIGHT - 1) / SOFTWARE_BAND_HEIGHT;
+    SoftwareFillChunk * chunk = &software->fill_chunks[c];
+    int * band_counts = software->fill_chunk_bands + (size_t) c * band_count;
+    memset(band_counts, 0, sizeof(int) * band_count);
+
+    FillEdge * edges = software->fill_edges + 3 * (size_t) chunk->first_point;
+    const int * starts = software->fill_starts;
+    const Vec2 * points = software->fill_points;
+    int polygon = chunk->polygon;
+    int edge_count = 0;
+    for (int v = chunk->first_point; v < chunk->end_point; v++) {
+        while (starts[polygon + 1] <= v) polygon++;
+        Vec2 b = v + 1 < starts[polygon + 1] ? points[v + 1] : points[starts[polygon]];
+
+        FillEdge * clipped = edges + edge_count;
+        int clipped_count = clip_fill_edge(points[v], b, software->width, clipped);
+        for (int k = 0; k < clipped_count; k++) {
+            FillEdge edge = clipped[k];
+            // keeping only edges that reach the framebuffer's rows
+            if (edge.y1 > 0 && edge.y0 < software->height) {
+                int first, last;
+                get_fill_edge_bands(&edge, software->height, &first, &last);
+                for (int band = first; band <= last; band++) {
+                    band_counts[band]++;
+                }
+                edges[edge_count++] = edge;
+            }
+        }
+    }
+    chunk->edge_count = edge_count;
+}
+
+/* Works out where each clipped chunk's edges go in fill_band_edges, band by band and
+   within a band chunk by chunk, so a band's edges keep the order the path gave them.
+   Returns false if fill_band_edges couldn't grow. */
+static bool SoftwareRenderer_place_fill_chunks(SoftwareRenderer * software) {
+    const int band_count = (software->height + SOFTWARE_BAND_HEIGHT - 1) / SOFTWARE_BAND_HEIGHT;
+
+    int edge_count = 0;
+    for (int f = 0; f < software->fill_count; f++) {
+        const SoftwareFill * fill = &software->fills[f];
+        int * band_starts = software->fill_band_starts + fill->first_band;
+        for (int band = 0; band < band_count; band++) {
+            band_starts[band] = edge_count;
+            for (int c = fill->first_chunk; c < fill->first_chunk + fill->chunk_count; c++) {
+                int * band_next = software->fill_chunk_bands + (size_t) c * band_count + band;
+                int chunk_edges = *band_next;
+                *band_next = edge_count;
+                edge_count += chunk_edges;
+            }
+        }
+        band_starts[band_count] = edge_count;
+    }
+
+    return reserve_buffer((void **) &software->fill_band_edges, &software->fill_band_edges_capacity,
+                          edge_count, sizeof(FillEdge));
+}
+
+// copies a clipped chunk's edges into each band they cross
+static void SoftwareRenderer_bin_fill_chunk(SoftwareRenderer * software, int c) {
+    const int band_count = (software->height + SOFTWARE_BAND_HEIGHT - 1) / SOFTWARE_BAND_HEIGHT;
+    const SoftwareFillChunk * chunk = &software->fill_chunks[c];
+    int * band_next = software->fill_chunk_bands + (size_t) c * band_count;
+
+    const FillEdge * edges = software->fill_edges + 3 * (size_t) chunk->first_point;
+    for (int e = 0; e < chunk->edge_count; e++) {
+        int first, last;
+        get_fill_edge_bands(&edges[e], software->height, &first, &last);
+        for (int band = first; band <= last; band++) {
+            software->fill_band_edges[band_next[band]++] = edges[e];
+        }
+    }
+}
+
+// blends color over a pixel, with its alpha scaled by coverage
+static inline void blend_pixel(Uint8 * pixel, SDL_Color color, float coverage) {
+    float a = color.a / 255.0f * coverage;
+    pixel[0] = color.r * a + pixel[0] * (1 - a) + 0.5f;
+    pixel[1] = color.g * a + pixel[1] * (1 - a) + 0.5f;
+    pixel[2] = color.b * a + pixel[2] * (1 - a) + 0.5f;
+    pixel[3] = 255 * a + pixel[3] * (1 - a) + 0.5f;
+}
+
+/* Draws a 1 pixel wide anti-aliased line, clipped to the tile. A pixel's coverage is
+   the analytic overlap of a 1 pixel wide box filter across the line, which for a
+   1 pixel wide line is 1 minus the distance from the pixel center to the segment. */
+void SoftwareRenderer_raster_line(SoftwareRenderer * software, SDL_Rect tile, SDL_Color color, Vec2 a, Vec2 b) {
+    // like SDL, integer coordinates are pixel centers
+    a = (Vec2) { a.x + 0.5f, a.y + 0.5f };
+    b = (Vec2) { b.x + 0.5f, b.y + 0.5f };
+
+    int x_min = floorf(fminf(a.x, b.x)) - 1;
+    int y_min = floorf(fminf(a.y, b.y)) - 1;
+    int x_max = ceilf(fmaxf(a.x, b.x)) + 1;
+    int y_max = ceilf(fmaxf(a.y, b.y)) + 1;
+    if (x_min < tile.x) x_min = tile.x;
+    if (y_min < tile.y) y_min = tile.y;
+    if (x_max > tile.x + tile.w) x_max = tile.x + tile.w;
+    if (y_max > tile.y + tile.h) y_max = tile.y + tile.h;
+
+    float dx = b.x - a.x;
+    float dy = b.y - a.y;
+    float length2 = dx * dx + dy * dy;
+
+    for (int y = y_min; y < y_max; y++) {
+        Uint8 * row = software->pixels + ((size_t) y * software->width) * 4;
+        for (int x = x_min; x < x_max; x++) {
+            float px = x + 0.5f - a.x;
+            float py = y + 0.5f - a.y;
+            float t = length2 > 0 ? (px * dx + py * dy) / length2 : 0;
+            if (t < 0) t = 0;
+            if (t > 1) t = 1;
+            float ex = px - t * dx;
+            float ey = py - t * dy;
+            float coverage = 1 - sqrtf(ex * ex + ey * ey);
+            if (coverage > 0) blend_pixel(row + x * 4, color, coverage);
+        }
+    }
+}
+
+// how much of a pixel is covered, from the winding accumulated up to it
+static inline float get_fill_coverage(float winding, FillRule rule) {
+    float a = fabsf(winding);
+    if (rule == FILL_EVEN_ODD) {
+        // fold windings of 1 to 2 back down to 0, as the path covers these areas twice
+        a -= 2 * (float) (int) (a * 0.5f);
+        return a < 2 - a ? a : 2 - a;
+    }
+    return a < 1 ? a : 1;
+}
+
+/* Adds a piece of an edge within a row, from xa to xb and with height d, to the row's
+   coverage changes, the way font rasterizers do: summing along the row gives how much
+   of each pixel is inside, and a pixel the piece passes through gets the part of it to
+   the piece's right. x is clipped to 0 to width, so converting to int rounds down here
+   (floorf and ceilf would be library calls without SSE4.1). */
+static inline void accumulate_fill_piece(float * row, float xa, float xb, float d) {
+    float x0 = xa < xb ? xa : xb;
+    float x1 = xa < xb ? xb : xa;
+
+    int x0i = x0;
+    int x1i = (int) x1 + ((int) x1 < x1);
+    float x0_floor = x0i;
+
+    if (x1i <= x0i + 1) {
+        // within a single pixel, which gets the part right of the piece's middle
+        float middle = 0.5f * (xa + xb) - x0_floor;
+        row[x0i] += d - d * middle;
+        row[x0i + 1] += d * middle;
+    } else {
+        // across several pixels, each getting a trapezoid of the triangle under the piece
+        float s = 1 / (x1 - x0);
+        float x0f = x0 - x0_floor;
+        float a0 = 0.5f * s * (1 - x0f) * (1 - x0f);
+        float x1f = x1 - x1i + 1;
+        float am = 0.5f * s * x1f * x1f;
+
+        row[x0i] += d * a0;
+        if (x1i == x0i + 2) {
+            row[x0i + 1] += d * (1 - a0 - am);
+        } else {
+            float a1 = s * (1.5f - x0f);
+            row[x0i + 1] += d * (a1 - a0);
+            for (int x = x0i + 2; x < x1i - 1; x++) {
+                row[x] += d * s;
+            }
+            float a2 = a1 + (x1i - x0i - 3) * s;
+            row[x1i - 1] += d * (1 - a2 - am);
+        }
+        row[x1i] += d * am;
+    }
+}
+
+/* Adds the edge's signed area to the accumulation rows of the tile (which spans the
+   framebuffer's width), a piece of the edge within each row at a time */
+static void accumulate_fill_edge(float * accumulation, int stride, SDL_Rect tile, const FillEdge * edge) {
+    // y1 is below the top of the band, so everything rounded here is positive too
+    int y_min = edge->y0 > tile.y ? (int) edge->y0 : tile.y;
+    int y_max = (int) edge->y1 + ((int) edge->y1 < edge->y1);
+    if (y_max > tile.y + tile.h) y_max = tile.y + tile.h;
+
+    const float dxdy = (edge->x1 - edge->x0) / (edge->y1 - edge->y0);
+
+    for (int y = y_min; y < y_max; y++) {
+        float top = y > edge->y0 ? y : edge->y0;
+        float bottom = y + 1 < edge->y1 ? y + 1 : edge->y1;
+        float xa = edge->x0 + (top - edge->y0) * dxdy;
+        float xb = edge->x0 + (bottom - edge->y0) * dxdy;
+        accumulate_fill_piece(accumulation + (y - tile.y) * stride, xa, xb, (bottom - top) * edge->direction);
+    }
+}
+
+// the coverage from which blending an opaque color gives exactly the color
+#define FILL_FULL_COVERAGE (1 - 1.0f / 512)
+
+/* Fills a row of pixels from the coverage changes accumulated for it, summing them
+   into the winding (carried over in *winding) and blending the color over each pixel
+   by its coverage. Like the batch evaluators, a kernel returns how many pixels it
+   handled and the rest are finished off one at a time. The kernels blend with the
+   same operations as blend_pixel, but sum each vector's lanes as a tree rather than
+   one after another, so the coverage can differ from the scalar sum in the last bit. */
+typedef int (*FillSpanKernel)(const float * row, int n, FillRule rule, SDL_Color color, float * winding,
+                              Uint8 * pixels);
+
+static int fill_span_none(const float * row, int n, FillRule rule, SDL_Color color, float * winding,
+                          Uint8 * pixels) {
+    return 0;
+}
+
+/* Adds the signed areas of count edges to the accumulation rows of
+   the tile, as accumulate_fill_edge does, and sets *x_min and *x_max to the range of
+   entries in a row that may have changed. The kernels give each piece of an edge
+   within a row the changes for a vector of pixels at once, which come out of the same
+   areas added up differently, so they can differ from accumulate_fill_edge's in the
+   last bit. */
+typedef void (*FillAccumulateKernel)(float * accumulation, int stride, SDL_Rect tile, const FillEdge * edges,
+                                     int count, int * x_min, int * x_max);
+
+static void fill_accumulate_none(float * accumulation, int stride, SDL_Rect tile, const FillEdge * edges,
+                                 int count, int * x_min, int * x_max) {
+    *x_min = stride;
+    *x_max = 0;
+    for (int k = 0; k < count; k++) {
+        const FillEdge * edge = &edges[k];
+        accumulate_fill_edge(accumulation, stride, tile, edge);
+
+        // from the pixel it starts in to the one after the pixel it ends in
+        float left = edge->x0 < edge->x1 ? edge->x0 : edge->x1;
+        float right = edge->x0 < edge->x1 ? edge->x1 : edge->x0;
+        int left_pixel = left;
+        int right_pixel = (int) right + ((int) right < right);
+        if (left_pixel < *x_min) *x_min = left_pixel;
+        if (right_pixel + 1 > *x_max) *x_max = right_pixel + 1;
+    }
+}
+
+#ifdef BEZIER_BATCH_SIMD
+
+// prefix sums of the lanes of v, shifting in zeros from the vector zero
+#define FILL_PREFIX_SUM_4(v, zero, vi)                                                              \
+    v += __builtin_shuffle(v, zero, (vi) { 4, 0, 1, 2 });                                           \
+    v += __builtin_shuffle(v, zero, (vi) { 4, 4, 0, 1 });
+
+#define FILL_PREFIX_SUM_8(v, zero, vi)                                                              \
+    v += __builtin_shuffle(v, zero, (vi) { 8, 0, 1, 2, 3, 4, 5, 6 });                               \
+    v += __builtin_shuffle(v, zero, (vi) { 8, 8, 0, 1, 2, 3, 4, 5 });                               \
+    v += __builtin_shuffle(v, zero, (vi) { 8, 8, 8, 8, 0, 1, 2, 3 });
+
+#define FILL_PREFIX_SUM_16(v, zero, vi)                                                             \
+    v += __builtin_shuffle(v, zero, (vi) { 16, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14 }); \
+    v += __builtin_shuffle(v, zero, (vi) { 16, 16, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13 }); \
+    v += __builtin_shuffle(v, zero, (vi) { 16, 16, 16, 16, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 }); \
+    v += __builtin_shuffle(v, zero, (vi) { 16, 16, 16, 16, 16, 16, 16, 16, 0, 1, 2, 3, 4, 5, 6, 7 });
+
+// the alphas of the pixels in quarter k of v, each repeated for the pixel's 4 channels
+#define FILL_SPREAD_4(v, k, vi) __builtin_shuffle(v, (vi) { k, k, k, k })
+#define FILL_SPREAD_8(v, k, vi) __builtin_shuffle(v, (vi) { 2 * k, 2 * k, 2 * k, 2 * k,                  \
+                                                            2 * k + 1, 2 * k + 1, 2 * k + 1, 2 * k + 1 })
+#define FILL_SPREAD_16(v, k, vi) __builtin_shuffle(v, (vi) { 4 * k, 4 * k, 4 * k, 4 * k,                 \
+                                                             4 * k + 1, 4 * k + 1, 4 * k + 1, 4 * k + 1, \
+                                                             4 * k + 2, 4 * k + 2, 4 * k + 2, 4 * k + 2, \
+                                                             4 * k + 3, 4 * k + 3, 4 * k + 3, 4 * k + 3 })
+
+#define DEFINE_FILL_SPAN_KERNEL(isa, target_name, lanes)                                            \
+typedef float isa##_fill_vf __attribute__((vector_size(lanes * sizeof(float))));                    \
+typedef int isa##_fill_vi __attribute__((vector_size(lanes * sizeof(int))));                        \
+typedef Uint8 isa##_fill_vb __attribute__((vector_size(lanes)));                                    \
+                                                                                                    \
+BATCH_KERNEL_TARGET(target_name)                                                                    \
+static inline isa##_fill_vf isa##_fill_min(isa##_fill_vf a, isa##_fill_vf b) {                     \
+    isa##_fill_vi less = a < b;                                                                     \
+    return (isa##_fill_vf) (((isa##_fill_vi) a & less) | ((isa##_fill_vi) b & ~less));              \
+}                                                                                                   \
+                                                                                                    \
+BATCH_KERNEL_TARGET(target_name)                                                                    \
+static inline isa##_fill_vf isa##_fill_max(isa##_fill_vf a, isa##_fill_vf b) {                     \
+    isa##_fill_vi less = a < b;                                                                     \
+    return (isa##_fill_vf) (((isa##_fill_vi) b & less) | ((isa##_fill_vi) a & ~less));              \
+}                                                                                                   \
+                                                                                                    \
+BATCH_KERNEL_TARGET(target_name)                                                                    \
+static inline bool isa##_fill_any(isa##_fill_vi mask) {                                             \
+    const isa##_fill_vi none = {0};                                                                 \
+    return memcmp(&mask, &none, sizeof(mask)) != 0;                                                 \
+}                                                                                                   \
+                                                                                                    \
+BATCH_KERNEL_TARGET(target_name)                                                                    \
+static int fill_span_##isa(const float * row, int n, FillRule rule, SDL_Color color, float * winding, \
+                           Uint8 * pixels) {                                                        \
+    const isa##_fill_vf zero = {0};                                                                 \
+    const isa##_fill_vf one = zero + 1;                                                             \
+    const float alpha_scale = color.a / 255.0f;                                                     \
+                                                                                                    \
+    /* the color's channels (and 255 for alpha, as blend_pixel does) for each pixel in a quarter */ \
+    isa##_fill_vf channels;                                                                         \
+    Uint32 packed_color;                                                                            \
+    for (int k = 0; k < lanes; k += 4) {                                                            \
+        channels[k] = color.r;                                                                      \
+        channels[k + 1] = color.g;                                                                  \
+        channels[k + 2] = color.b;                                                                  \
+        channels[k + 3] = 255;                                                                      \
+    }                                                                                               \
+    memcpy(&packed_color, &color, sizeof(packed_color));                                            \
+                                                                                                    \
+    int i = 0;                                                                                      \
+    for (; i + lanes <= n; i += lanes) {                                                            \
+        isa##_fill_vf v;                                                                            \
+        memcpy(&v, row + i, sizeof(v));                                                             \
+        FILL_PREFIX_SUM_##lanes(v, zero, isa##_fill_vi)                                             \
+        v += *winding;                                                                              \
+        *winding = v[lanes - 1];                                                                    \
+                                                                                                    \
+        /* the same steps as get_fill_coverage, taking the minimum with a mask */                   \
+        v = (isa##_fill_vf) ((isa##_fill_vi) v & 0x7FFFFFFF);                                       \
+        if (rule == FILL_EVEN_ODD) {                                                                \
+            v -= 2 * __builtin_convertvector(__builtin_convertvector(v * 0.5f, isa##_fill_vi),      \
+                                             isa##_fill_vf);                                        \
+        }                                                                                           \
+        v = isa##_fill_min(v, rule == FILL_EVEN_ODD ? 2 - v : one);                                 \
+                                                                                                    \
+        /* uncovered pixels are left alone, and covered ones just get the color if it's opaque */   \
+        Uint8 * pixel = pixels + i * 4;                                                             \
+        if (!isa##_fill_any(v > 0)) continue;                                                       \
+        if (color.a == 0xFF && !isa##_fill_any(v < FILL_FULL_COVERAGE)) {                           \
+            for (int k = 0; k < lanes; k++) {                                                       \
+                memcpy(pixel + k * 4, &packed_color, 4);                                            \
+            }                                                                                       \
+            continue;                                                                               \
+        }                                                                                           \
+                                                                                                    \
+        /* blend a quarter of the pixels at a time, which are lanes channels */                     \
+        isa##_fill_vf alpha = alpha_scale * v;                                                      \
+        isa##_fill_vf quarters[4] = {                                                               \
+            FILL_SPREAD_##lanes(alpha, 0, isa##_fill_vi),                                           \
+            FILL_SPREAD_##lanes(alpha, 1, isa##_fill_vi),                                           \
+            FILL_SPREAD_##lanes(alpha, 2, isa##_fill_vi),                                           \
+            FILL_SPREAD_##lanes(alpha, 3, isa##_fill_vi),                                           \
+        };                                                                                          \
+        for (int k = 0; k < 4; k++) {                                                               \
+            isa##_fill_vb bytes;                                                                    \
+            memcpy(&bytes, pixel + k * lanes, sizeof(bytes));                                       \
+            isa##_fill_vf a = quarters[k];                                                          \
+            isa##_fill_vf blended = channels * a + __builtin_convertvector(bytes, isa##_fill_vf) * (1 - a) + 0.5f; \
+            bytes = __builtin_convertvector(__builtin_convertvector(blended, isa##_fill_vi), isa##_fill_vb); \
+            memcpy(pixel + k * lanes, &bytes, sizeof(bytes));                                       \
+        }                                                                                           \
+    }                                                                                               \
+    return i;                                                                                       \
+}
+
+DEFINE_FILL_SPAN_KERNEL(sse2, "sse2", 4)
+DEFINE_FILL_SPAN_KERNEL(avx2, "avx2", 8)
+DEFINE_FILL_SPAN_KERNEL(avx512, "avx512f", 16)
+
+/* The accumulate kernel works from the area a piece of an edge within a row covers: a
+   piece from x0 to x1 with height d covers the part of the row right of it, which at x
+   is d times the fraction of the piece left of x. The winding it adds to a pixel is d
+   times the integral of that fraction over the pixel, so the change from the pixel
+   before is d (G(u + 1) - 2 G(u) + G(u - 1)), u being the pixel's left side and G the
+   integral of the fraction from the left. Relative to the pixel the piece starts in,
+   G(u) = clamp(u - x0, 0, x1 - x0)^2 / (2 (x1 - x0)) + max(u - x1, 0).
+
+   The kernel works these out for the pieces in 4 rows of an edge at a time, which is
+   about as many as an edge crosses here (a flattened curve's edges being a few pixels
+   long), so wider vectors would mostly be empty. The changes are then added to each
+   row one pixel at a time: adding a vector at a time is slower, as a vector added at
+   one pixel can't be forwarded to the next piece's load at a neighbouring pixel. */
+
+// most pixels the accumulate kernel adds a piece of an edge to at once
+#define FILL_PIECE_PIXELS 4
+
+BATCH_KERNEL_TARGET("sse2")
+static void fill_accumulate_sse2(float * accumulation, int stride, SDL_Rect tile, const FillEdge * edges,
+                                  int count, int * x_min, int * x_max) {
+    const sse2_fill_vf zero = {0};
+    sse2_fill_vf lane;
+    for (int k = 0; k < 4; k++) lane[k] = k;
+
+    int left = stride;
+    int right = 0;
+    for (int e = 0; e < count; e++) {
+        const FillEdge * edge = &edges[e];
+        // everything rounded is positive here, as in accumulate_fill_edge
+        int y_min = edge->y0 > tile.y ? (int) edge->y0 : tile.y;
+        int y_max = (int) edge->y1 + ((int) edge->y1 < edge->y1);
+        if (y_max > tile.y + tile.h) y_max = tile.y + tile.h;
+
+        const float dxdy = (edge->x1 - edge->x0) / (edge->y1 - edge->y0);
+
+        for (int y = y_min; y < y_max; y += 4) {
+            // the pieces of the edge within rows y onwards, as in accumulate_fill_edge
+            sse2_fill_vf rows = lane + (float) y;
+            sse2_fill_vf top = sse2_fill_max(rows, zero + edge->y0);
+            sse2_fill_vf bottom = sse2_fill_min(rows + 1, zero + edge->y1);
+            sse2_fill_vf d = (bottom - top) * edge->direction;
+            sse2_fill_vf xa = edge->x0 + (top - edge->y0) * dxdy;
+            sse2_fill_vf xb = edge->x0 + (bottom - edge->y0) * dxdy;
+            sse2_fill_vf x0 = sse2_fill_min(xa, xb);
+            sse2_fill_vf x1 = sse2_fill_max(xa, xb);
+
+            sse2_fill_vi x0i = __builtin_convertvector(x0, sse2_fill_vi);
+            sse2_fill_vi x1i = __builtin_convertvector(x1, sse2_fill_vi);
+            x1i -= __builtin_convertvector(x1i, sse2_fill_vf) < x1;
+            sse2_fill_vi last = x1i - x0i;
+
+            // G at the right sides of the first few pixels (G(0) and G(-1) being 0)
+            sse2_fill_vf start = x0 - __builtin_convertvector(x0i, sse2_fill_vf);
+            sse2_fill_vf end = x1 - __builtin_convertvector(x0i, sse2_fill_vf);
+            sse2_fill_vf width = end - start;
+            sse2_fill_vf h = (sse2_fill_vf) ((sse2_fill_vi) (0.5f / width) & (width > 0));
+            sse2_fill_vf g[FILL_PIECE_PIXELS + 1] = { zero };
+            for (int k = 1; k <= FILL_PIECE_PIXELS; k++) {
+                sse2_fill_vf inside = sse2_fill_max(sse2_fill_min((float) k - start, width), zero);
+                g[k] = inside * inside * h + sse2_fill_max((float) k - end, zero);
+            }
+
+            // the changes to those pixels, past the last pixel being 0
+            sse2_fill_vf changes[FILL_PIECE_PIXELS];
+            for (int k = 0; k < FILL_PIECE_PIXELS; k++) {
+                sse2_fill_vf change = d * ((g[k + 1] - g[k]) - (g[k] - (k ? g[k - 1] : zero)));
+                changes[k] = (sse2_fill_vf) ((sse2_fill_vi) change & (last >= k));
+            }
+
+            int n = y_max - y < 4 ? y_max - y : 4;
+            for (int k = 0; k < n; k++) {
+                float * row = accumulation + (y + k - tile.y) * stride;
+                if (x0i[k] < left) left = x0i[k];
+                if (x1i[k] + 1 > right) right = x1i[k] + 1;
+
+                // the few pieces across more pixels are added one pixel at a time
+                if (last[k] >= FILL_PIECE_PIXELS) {
+                    accumulate_fill_piece(row, xa[k], xb[k], d[k]);
+                    continue;
+                }
+                for (int j = 0; j < FILL_PIECE_PIXELS; j++) {
+                    row[x0i[k] + j] += changes[j][k];
+                }
+            }
+        }
+    }
+    *x_min = left;
+    *x_max = right;
+}
+
+#endif
+
+static FillSpanKernel fill_span_kernel = fill_span_none;
+static FillAccumulateKernel fill_accumulate_kernel = fill_accumulate_none;
+
+/* Picks the fill kernels for this CPU. Called by SoftwareRenderer_init, so it happens
+   before any raster threads are started, which only ever read the kernels. */
+void select_fill_kernels(void) {
+    static bool selected;
+    if (selected) return;
+
+#ifdef BEZIER_BATCH_SIMD
+    if (SDL_HasAVX512F()) {
+        fill_span_kernel = fill_span_avx512;
+    } else if (SDL_HasAVX2()) {
+        fill_span_kernel = fill_span_avx2;
+    } else if (SDL_HasSSE2()) {
+        fill_span_kernel = fill_span_sse2;
+    }
+    // 4 rows at a time whatever the vector width, see fill_accumulate_sse2
+    if (SDL_HasSSE2()) fill_accumulate_kernel = fill_accumulate_sse2;
+#endif
+
+    selected = true;
+}
+
+bool SoftwareRenderer_init(SoftwareRenderer * software, int width, int height) {
+    *software = (SoftwareRenderer) {0};
+
+    software->width = width;
+    software->height = height;
+    software->pixels = malloc((size_t) width * height * 4);
+    if (!software->pixels) {
+        printf("Could not allocate %dx%d framebuffer\n", width, height);
+        return false;
+    }
+
+    software->thread_count = get_worker_count();
+    select_fill_kernels();
+
+    return WorkerThreads_init(&software->workers);
+}
+
+void SoftwareRenderer_cleanup(SoftwareRenderer * software) {
+    WorkerThreads_cleanup(&software->workers);
+    free(software->pixels);
+    free(software->commands);
+    free(software->vertices);
+    free(software->rects);
+    free(software->fills);
+    free(software->fill_points);
+    free(software->fill_starts);
+    free(software->fill_chunks);
+    free(software->fill_chunk_bands);
+    free(software->fill_edges);
+    free(software->fill_band_edges);
+    free(software->fill_band_starts);
+    free(software->accumulation);
+    *software = (SoftwareRenderer) {0};
+}
+
+
+// fills pixels x up to end of a row from its accumulated coverage changes, carrying the winding along
+static void fill_row(const float * row, int x, int end, FillRule rule, SDL_Color color, float * winding,
+                     Uint8 * pixels) {
+    for (x += fill_span_kernel(row + x, end - x, rule, color, winding, pixels + x * 4); x < end; x++) {
+        *winding += row[x];
+        float coverage = get_fill_coverage(*winding, rule);
+        if (coverage <= 0) continue;
+
+        // an opaque color over anything within 1/512 of full coverage blends to exactly the color
+        if (coverage >= FILL_FULL_COVERAGE && color.a == 0xFF) {
+            memcpy(pixels + x * 4, &color, 4);
+        } else {
+            blend_pixel(pixels + x * 4, color, coverage);
+        }
+    }
+}
+
+// the most lanes of any fill kernel, which spans of a row start at a multiple of
+#define FILL_SPAN_ALIGNMENT 16
+
+/* Fills the rows of the tile inside the path: accumulates its edges crossing the band,
+   then turns each row into coverage and blends the color over it, leaving the
+   accumulation rows zeroed again. Left of the edges every row's winding is 0, and
+   right of them it stays at whatever it reached, so only the pixels between them are
+   summed unless that still covers anything. Spans start at a multiple of
+   FILL_SPAN_ALIGNMENT, so the kernels sum the same lanes together as from the start
+   of the row. */
+void SoftwareRenderer_raster_fill(SoftwareRenderer * software, SDL_Rect tile, const SoftwareFill * fill,
+                                  SDL_Color color, float * accumulation) {
+    const int stride = software->width + FILL_ROW_PADDING;
+    const int band = tile.y / SOFTWARE_BAND_HEIGHT;
+    const int * band_starts = software->fill_band_starts + fill->first_band;
+
+    // with no edges crossing the band every row's winding stays 0, so nothing is covered
+    if (band_starts[band] == band_starts[band + 1]) return;
+
+    int x_min, x_max;
+    fill_accumulate_kernel(accumulation, stride, tile, software->fill_band_edges + band_starts[band],
+                           band_starts[band + 1] - band_starts[band], &x_min, &x_max);
+
+    const int span_start = x_min / FILL_SPAN_ALIGNMENT * FILL_SPAN_ALIGNMENT;
+    int span_end = (x_max + FILL_SPAN_ALIGNMENT - 1) / FILL_SPAN_ALIGNMENT * FILL_SPAN_ALIGNMENT;
+    if (span_end > software->width) span_end = software->width;
+
+    for (int y = tile.y; y < tile.y + tile.h; y++) {
+        float * row = accumulation + (y - tile.y) * stride;
+        Uint8 * pixels = software->pixels + (size_t) y * software->width * 4;
+
+        float winding = 0;
+        fill_row(row, span_start, span_end, fill->rule, color, &winding, pixels);
+        if (span_end < software->width && get_fill_coverage(winding, fill->rule) > 0) {
+            fill_row(row, span_end, software->width, fill->rule, color, &winding, pixels);
+        }
+        memset(row + x_min, 0, sizeof(float) * (x_max - x_min));
+    }
+}
+// replays the whole display list for the pixels inside the tile
+void SoftwareRenderer_raster_tile(SoftwareRenderer * software, SDL_Rect tile, float * accumulation) {
+    for (int i = 0; i < software->command_count; i++) {
+        const SoftwareCommand * command = &software->commands[i];
+
+        switch (command->type) {
+            case SOFTWARE_CLEAR:
+            {
+                for (int y = tile.y; y < tile.y + tile.h; y++) {
+                    Uint8 * pixel = software->pixels + ((size_t) y * software->width + tile.x) * 4;
+                    for (int x = 0; x < tile.w; x++, pixel += 4) {
+                        pixel[0] = command->color.r;
+                        pixel[1] = command->color.g;
+                        pixel[2] = command->color.b;
+                        pixel[3] = command->color.a;
+                    }
+                }
+            } break;
+
+            case SOFTWARE_POLYLINE:
+            {
+                const Vec2 * vertices = software->vertices + command->first;
+                for (int v = 1; v < command->count; v++) {
+                    SoftwareRenderer_raster_line(software, tile, command->color, vertices[v - 1], vertices[v]);
+                }
+            } break;
+
+            case SOFTWARE_RECTS:
+            {
+                for (int r = 0; r < command->count; r++) {
+                    SDL_Rect rect = software->rects[command->first + r];
+                    int x_min = rect.x > tile.x ? rect.x : tile.x;
+                    int y_min = rect.y > tile.y ? rect.y : tile.y;
+                    int x_max = rect.x + rect.w < tile.x + tile.w ? rect.x + rect.w : tile.x + tile.w;
+                    int y_max = rect.y + rect.h < tile.y + tile.h ? rect.y + rect.h : tile.y + tile.h;
+
+                    for (int y = y_min; y < y_max; y++) {
+                        for (int x = x_min; x < x_max; x++) {
+                            blend_pixel(software->pixels + ((size_t) y * software->width + x) * 4, command->color, 1);
+                        }
+                    }
+                }
+            } break;
+
+            case SOFTWARE_ATLAS_RECTS:
+            {
+                const SDL_Surface * atlas = software->atlas;
+                for (int r = 0; r < command->count / 2; r++) {
+                    SDL_Rect src = software->rects[command->first + 2 * r];
+                    SDL_Rect dst = software->rects[command->first + 2 * r + 1];
+                    int x_min = dst.x > tile.x ? dst.x : tile.x;
+                    int y_min = dst.y > tile.y ? dst.y : tile.y;
+                    int x_max = dst.x + dst.w < tile.x + tile.w ? dst.x + dst.w : tile.x + tile.w;
+                    int y_max = dst.y + dst.h < tile.y + tile.h ? dst.y + dst.h : tile.y + tile.h;
+
+                    for (int y = y_min; y < y_max; y++) {
+                        const Uint8 * glyph_row = (const Uint8 *) atlas->pixels + (src.y + y - dst.y) * atlas->pitch;
+                        for (int x = x_min; x < x_max; x++) {
+                            const Uint8 * texel = glyph_row + (src.x + x - dst.x) * 4;
+                            SDL_Color color = {
+                                texel[0] * command->color.r / 255,
+                                texel[1] * command->color.g / 255,
+                                texel[2] * command->color.b / 255,
+                                texel[3] * command->color.a / 255,
+                            };
+                            if (color.a) blend_pixel(software->pixels + ((size_t) y * software->width + x) * 4, color, 1);
+                        }
+                    }
+                }
+            } break;
+
+            case SOFTWARE_FILL:
+            {
+                SoftwareRenderer_raster_fill(software, tile, &software->fills[command->first], command->color, accumulation);
+            } break;
+        }
+    }
+}
+
+typedef struct {
+    SoftwareRenderer * software;
+    /* the next chunk of edges or band of rows to take */
+    SDL_atomic_t next;
+} SoftwareRasterJob;
+
+// clips chunks of filled paths' edges until there are none left
+static void software_clip_worker(void * data, int worker) {
+    SoftwareRasterJob * job = data;
+    for (;;) {
+        int chunk = SDL_AtomicAdd(&job->next, 1);
+        if (chunk >= job->software->fill_chunk_count) break;
+        SoftwareRenderer_clip_fill_chunk(job->software, chunk);
+    }
+}
+
+// bins chunks of filled paths' clipped edges until there are none left
+static void software_bin_worker(void * data, int worker) {
+    SoftwareRasterJob * job = data;
+    for (;;) {
+        int chunk = SDL_AtomicAdd(&job->next, 1);
+        if (chunk >= job->software->fill_chunk_count) break;
+        SoftwareRenderer_bin_fill_chunk(job->software, chunk);
+    }
+}
+
+// rasterizes bands of rows until there are none left
+static void software_raster_worker(void * data, int worker) {
+    SoftwareRasterJob * job = data;
+    SoftwareRenderer * software = job->software;
+
+    // each worker fills paths using its own band of accumulation rows
+    float * accumulation = software->accumulation
+        ? software->accumulation + (size_t) worker * SOFTWARE_BAND_HEIGHT * (software->width + FILL_ROW_PADDING)
+        : NULL;
+
+    int bands = (software->height + SOFTWARE_BAND_HEIGHT - 1) / SOFTWARE_BAND_HEIGHT;
+
+    for (;;) {
+        int band = SDL_AtomicAdd(&job->next, 1);
+        if (band >= bands) break;
+
+        SDL_Rect rect = { 0, band * SOFTWARE_BAND_HEIGHT, software->width, SOFTWARE_BAND_HEIGHT };
+        if (rect.y + rect.h > software->height) rect.h = software->height - rect.y;
+
+        SoftwareRenderer_raster_tile(software, rect, accumulation);
+    }
+}
+
+/* Rasterizes the recorded frame into the framebuffer and clears the display list.
+   Filled paths' edges are clipped and binned first, each step spread across the
+   threads like the bands are. Returns false, leaving the framebuffer as it was, if
+   there wasn't room to bin the edges. */
+bool SoftwareRenderer_present(SoftwareRenderer * software) {
+    bool success = true;
+    if (software->fill_chunk_count > 0) {
+        SoftwareRasterJob clip_job = { software };
+        SDL_AtomicSet(&clip_job.next, 0);
+        WorkerThreads_run(&software->workers, software->thread_count, software_clip_worker, &clip_job);
+
+        success = SoftwareRenderer_place_fill_chunks(software);
+        if (success) {
+            SoftwareRasterJob bin_job = { software };
+            SDL_AtomicSet(&bin_job.next, 0);
+            WorkerThreads_run(&software->workers, software->thread_count, software_bin_worker, &bin_job);
+        }
+    }
+
+    if (success) {
+        SoftwareRasterJob job = { software };
+        SDL_AtomicSet(&job.next, 0);
+        WorkerThreads_run(&software->workers, software->thread_count, software_raster_worker, &job);
+    }
+
+    software->command_count = 0;
+    software->vertex_count = 0;
+    software->rect_count = 0;
+    software->fill_count = 0;
+    software->fill_point_count = 0;
+    software->fill_start_count = 0;
+    software->fill_chunk_count = 0;
+    software->fill_band_start_count = 0;
+    return success;
+}
+
+// writes the framebuffer as a binary PPM (dropping alpha)
+bool SoftwareRenderer_write_ppm(const SoftwareRenderer * software, const char * path) {
+    FILE * file = fopen(path, "wb");
+    if (!file) {
+        printf("Could not open %s for writing\n", path);
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", software->width, software->height);
+
+    Uint8 * row = malloc((size_t) software->width * 3);
+    bool success = row != NULL;
+    for (int y = 0; success && y < software->height; y++) {
+        const Uint8 * pixel = software->pixels + (size_t) y * software->width * 4;
+        for (int x = 0; x < software->width; x++) {
+            memcpy(row + x * 3, pixel + x * 4, 3);
+        }
+        success = fwrite(row, 3, software->width, file) == (size_t) software->width;
+    }
+    free(row);
+
+    if (fclose(file) || !success) {
+        printf("Failed to write %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+void Canvas_set_color(Canvas * canvas, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    if (canvas->renderer) {
+        SDL_SetRenderDrawColor(canvas->renderer, r, g, b, a);
+    } else {
+        canvas->software->color = (SDL_Color) { r, g, b, a };
+    }
+}
+
+/* Draws the paths filled since anything else was drawn: clears the rows they span in
+   the fill layer, rasterizes them all there, then uploads those rows once and draws
+   them over the frame with premultiplied alpha, as that is what blending into a
+   transparent layer leaves. Called before anything else is drawn, so the fills stay
+   in order with it. Returns false if the layer couldn't be rasterized or drawn. */
+static bool Canvas_draw_fills(Canvas * canvas) {
+    SDL_Rect rows = canvas->fill_rows;
+    if (rows.h <= 0) return true;
+    canvas->fill_rows = (SDL_Rect) {0};
+
+    SoftwareRenderer * layer = &canvas->fill_layer;
+    memset(layer->pixels + (size_t) rows.y * layer->width * 4, 0, (size_t) rows.h * layer->width * 4);
+    if (!SoftwareRenderer_present(layer)) return false;
+
+    const Uint8 * pixels = layer->pixels + (size_t) rows.y * layer->width * 4;
+    if (SDL_UpdateTexture(canvas->fill_texture, &rows, pixels, layer->width * 4) ||
+        SDL_RenderCopy(canvas->renderer, canvas->fill_texture, &rows, &rows)) {
+        printf("Could not draw fill texture: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void Canvas_clear(Canvas * canvas) {
+    PROFILE_COUNT_DRAW_CALL();
+    if (canvas->renderer) {
+        // Canvas_draw_fills reports its own errors, and the fills are gone either way
+        Canvas_draw_fills(canvas);
+        SDL_RenderClear(canvas->renderer);
+    } else {
+        SoftwareRenderer_add_command(canvas->software, SOFTWARE_CLEAR, 0, 0);
+    }
+}
+
+/* Draws count polylines, polyline i being points[starts[i]] up to points[starts[i + 1]],
+   in a single draw call. With a renderer each segment becomes a quad 1 pixel wide,
+   reaching half a pixel past its ends so that segments join up and a segment of no
+   length still covers its pixel, and all of them go to one SDL_RenderGeometry call.
+   Returns false if the vertex buffers couldn't grow. */
+bool Canvas_draw_polylines(Canvas * canvas, const Vec2 * points, const int * starts, int count) {
+    PROFILE_COUNT_DRAW_CALL();
+    if (!canvas->renderer) {
+        return SoftwareRenderer_add_polylines(canvas->software, points, starts, count);
+    }
+    if (!Canvas_draw_fills(canvas)) return false;
+
+    int segment_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (starts[i + 1] > starts[i]) segment_count += starts[i + 1] - starts[i] - 1;
+    }
+    if (!reserve_buffer((void **) &canvas->line_vertices, &canvas->line_vertices_capacity,
+                        segment_count * 4, sizeof(SDL_Vertex)) ||
+        !reserve_buffer((void **) &canvas->line_indices, &canvas->line_indices_capacity,
+                        segment_count * 6, sizeof(int))) {
+        return false;
+    }
+
+    SDL_Color color;
+    SDL_GetRenderDrawColor(canvas->renderer, &color.r, &color.g, &color.b, &color.a);
+
+    int quad = 0;
+    for (int i = 0; i < count; i++) {
+        for (int v = starts[i] + 1; v < starts[i + 1]; v++, quad++) {
+            // pixel centers are at half coordinates, like SDL_RenderDrawLines puts them
+            Vec2 a = { points[v - 1].x + 0.5f, points[v - 1].y + 0.5f };
+            Vec2 b = { points[v].x + 0.5f, points[v].y + 0.5f };
+
+            // half a pixel along the segment and across it
+            Vec2 along = { 0.5f, 0 };
+            float length = sqrtf((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+            if (length > 0) along = (Vec2) { 0.5f * (b.x - a.x) / length, 0.5f * (b.y - a.y) / length };
+            Vec2 across = { -along.y, along.x };
+
+            SDL_Vertex * vertices = canvas->line_vertices + quad * 4;
+            vertices[0] = (SDL_Vertex) { { a.x - along.x + across.x, a.y - along.y + across.y }, color };
+            vertices[1] = (SDL_Vertex) { { a.x - along.x - across.x, a.y - along.y - across.y }, color };
+            vertices[2] = (SDL_Vertex) { { b.x + along.x - across.x, b.y + along.y - across.y }, color };
+            vertices[3] = (SDL_Vertex) { { b.x + along.x + across.x, b.y + along.y + across.y }, color };
+
+            int * indices = canvas->line_indices + quad * 6;
+            indices[0] = quad * 4; indices[1] = quad * 4 + 1; indices[2] = quad * 4 + 2;
+            indices[3] = quad * 4; indices[4] = quad * 4 + 2; indices[5] = quad * 4 + 3;
+        }
+    }
+
+    if (segment_count == 0) return true;
+    if (SDL_RenderGeometry(canvas->renderer, NULL, canvas->line_vertices, segment_count * 4,
+                           canvas->line_indices, segment_count * 6)) {
+        printf("Could not draw polylines: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void Canvas_fill_rects(Canvas * canvas, const SDL_Rect * rects, int count) {
+    PROFILE_COUNT_DRAW_CALL();
+    if (canvas->renderer) {
+        // like SDL_RenderFillRects, this reports errors without stopping the frame
+        Canvas_draw_fills(canvas);
+        SDL_RenderFillRects(canvas->renderer, rects, count);
+    } else {
+        SoftwareRenderer_add_rects(canvas->software, SOFTWARE_RECTS, rects, count);
+    }
+}
+
+/* Fills count closed polygons as one path, polygon i being points[starts[i]] up to
+   points[starts[i + 1]] (as laid out for Canvas_draw_polylines). With a renderer the
+   path is recorded into the fill layer, and all the paths filled before anything else
+   is drawn are rasterized there together by Canvas_draw_fills. Returns false if a
+   buffer or the texture couldn't be made. */
+bool Canvas_fill_path(Canvas * canvas, const Vec2 * points, const int * starts, int count, FillRule rule) {
+    PROFILE_COUNT_DRAW_CALL();
+    if (!canvas->renderer) {
+        return SoftwareRenderer_add_fill(canvas->software, points, starts, count, rule);
+    }
+
+    int width, height;
+    if (SDL_GetRendererOutputSize(canvas->renderer, &width, &height)) {
+        printf("Could not get renderer output size: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SoftwareRenderer * layer = &canvas->fill_layer;
+    if (layer->width != width || layer->height != height) {
+        SoftwareRenderer_cleanup(layer);
+        if (canvas->fill_texture) SDL_DestroyTexture(canvas->fill_texture);
+        canvas->fill_texture = NULL;
+        canvas->fill_rows = (SDL_Rect) {0};
+
+        if (!SoftwareRenderer_init(layer, width, height)) return false;
+
+        canvas->fill_texture = SDL_CreateTexture(
+            canvas->renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, width, height
+        );
+        if (!canvas->fill_texture) {
+            printf("Could not create fill texture: %s\n", SDL_GetError());
+            return false;
+        }
+        SDL_BlendMode premultiplied = SDL_ComposeCustomBlendMode(
+            SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+            SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD
+        );
+        if (SDL_SetTextureBlendMode(canvas->fill_texture, premultiplied)) {
+            printf("Could not set fill texture blend mode: %s\n", SDL_GetError());
+            return false;
+        }
+    }
+
+    // the rows the path's edges can cover, which are all that needs clearing and drawing
+    float y_min = height;
+    float y_max = -1;
+    for (int i = starts[0]; i < starts[count]; i++) {
+        if (points[i].y < y_min) y_min = points[i].y;
+        if (points[i].y > y_max) y_max = points[i].y;
+    }
+    SDL_Rect rows = { 0, y_min > 0 ? (int) y_min : 0, width, 0 };
+    rows.h = (y_max < height - 1 ? (int) y_max + 1 : height) - rows.y;
+    if (rows.h <= 0) return true;
+
+    Uint8 r, g, b, a;
+    SDL_GetRenderDrawColor(canvas->renderer, &r, &g, &b, &a);
+    layer->color = (SDL_Color) { r, g, b, a };
+    if (!SoftwareRenderer_add_fill(layer, points, starts, count, rule)) return false;
+
+    if (canvas->fill_rows.h > 0) {
+        SDL_UnionRect(&canvas->fill_rows, &rows, &canvas->fill_rows);
+    } else {
+        canvas->fill_rows = rows;
+    }
+    return true;
+}
+
+// copies glyphs from the atlas, rects holding (source, destination) pairs, in a single draw call
+void Canvas_draw_atlas(Canvas * canvas, const GlyphAtlas * atlas, const SDL_Rect * rects, int count) {
+    PROFILE_COUNT_DRAW_CALL();
+    if (!canvas->renderer) {
+        canvas->software->atlas = atlas->surface;
+        SoftwareRenderer_add_rects(canvas->software, SOFTWARE_ATLAS_RECTS, rects, count * 2);
+        return;
+    }
+
+    assert(count <= MAX_TEXT_QUADS);
+    Canvas_draw_fills(canvas);
+
+    const SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+    SDL_Vertex vertices[MAX_TEXT_QUADS * 4];
+    int indices[MAX_TEXT_QUADS * 6];
+
+    for (int i = 0; i < count; i++) {
+        SDL_Rect src = rects[2 * i];
+        SDL_Rect dst = rects[2 * i + 1];
+
+        float x1 = dst.x;
+        float x2 = dst.x + dst.w;
+        float y1 = dst.y;
+        float y2 = dst.y + dst.h;
+        float u1 = (float) src.x / atlas->width;
+        float u2 = (float) (src.x + src.w) / atlas->width;
+        float v1 = (float) src.y / atlas->height;
+        float v2 = (float) (src.y + src.h) / atlas->height;
+
+        SDL_Vertex * v = vertices + i * 4;
+        v[0] = (SDL_Vertex) { { x1, y1 }, white, { u1, v1 } };
+        v[1] = (SDL_Vertex) { { x2, y1 }, white, { u2, v1 } };
+        v[2] = (SDL_Vertex) { { x2, y2 }, white, { u2, v2 } };
+        v[3] = (SDL_Vertex) { { x1, y2 }, white, { u1, v2 } };
+
+        int * idx = indices + i * 6;
+        int base = i * 4;
+        idx[0] = base; idx[1] = base + 1; idx[2] = base + 2;
+        idx[3] = base; idx[4] = base + 2; idx[5] = base + 3;
+    }
+
+    SDL_RenderGeometry(canvas->renderer, atlas->texture, vertices, count * 4, indices, count * 6);
+}
+
+// returns false if the frame's fills or the software renderer's display list couldn't be drawn
+bool Canvas_present(Canvas * canvas) {
+    if (!canvas->renderer) return SoftwareRenderer_present(canvas->software);
+
+    bool success = Canvas_draw_fills(canvas);
+    SDL_RenderPresent(canvas->renderer);
+    return success;
+}
+
+void RenderState_cleanup(RenderState * state) {
+    GlyphAtlas_cleanup(&state->atlas);
+    PointGrid_cleanup(&state->grid);
+    CurveDocument_cleanup(&state->doc);
+    for (int i = 0; i < 3; i++) {
+        CurveDocument_cleanup(&state->snapshots[i].doc);
+    }
+    FrameArena_cleanup(&state->frame_arena);
+    TessellationPool_cleanup(&state->tessellation);
+    PolylineCache_cleanup(&state->polyline_cache);
+    // the canvas's fill layer and line buffers, leaving its renderer or software renderer to whoever made them
+    SoftwareRenderer_cleanup(&state->canvas.fill_layer);
+    if (state->canvas.fill_texture) SDL_DestroyTexture(state->canvas.fill_texture);
+    free(state->canvas.line_vertices);
+    free(state->canvas.line_indices);
+    SDL_DestroyCond(state->published);
+    SDL_DestroyMutex(state->mutex);
+}
+
+static int compare_doubles(const void * a, const void * b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+#ifdef BEZIER_PROFILE
+/* Draws the frame time percentiles of the frames in the profiler's ring in the top
+   left corner, with the mean time of each stage and the mean number of draw calls */
+void draw_profile_overlay(Canvas * canvas, const GlyphAtlas * atlas) {
+    const int frame_count = profiler.frame_count < PROFILE_FRAMES ? profiler.frame_count : PROFILE_FRAMES;
+    if (frame_count == 0) return;
+
+    double frame_ms[PROFILE_FRAMES];
+    double stage_ms[PROFILE_STAGE_COUNT] = {0};
+    double draw_calls = 0;
+    for (int i = 0; i < frame_count; i++) {
+        const FrameProfile * frame = &profiler.frames[i];
+        frame_ms[i] = frame->stage_seconds[PROFILE_STAGE_FRAME] * 1e3;
+        for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+            stage_ms[s] += frame->stage_seconds[s] * 1e3 / frame_count;
+        }
+        draw_calls += (double) frame->draw_calls / frame_count;
+    }
+    qsort(frame_ms, frame_count, sizeof(double), compare_doubles);
+
+    // the frame line, the draw call line, then a line per stage besides the frame
+    char lines[PROFILE_STAGE_COUNT + 1][48];
+    snprintf(
+        lines[0], sizeof(lines[0]), "frame ms p50 %.2f p90 %.2f p99 %.2f",
+        frame_ms[frame_count / 2], frame_ms[frame_count * 9 / 10], frame_ms[frame_count * 99 / 100]
+    );
+    snprintf(lines[1], sizeof(lines[1]), "draw calls %.1f", draw_calls);
+    for (int s = 1; s < PROFILE_STAGE_COUNT; s++) {
+        snprintf(lines[s + 1], sizeof(lines[s + 1]), "%s %.3f", PROFILE_STAGE_NAMES[s], stage_ms[s]);
+    }
+    const int line_count = PROFILE_STAGE_COUNT + 1;
+
+    const int padding = 6;
+    SDL_Rect box = { 0, 0, 0, line_count * atlas->height + 2 * padding };
+    for (int i = 0; i < line_count; i++) {
+        int width = get_atlas_text_width(atlas, lines[i]) + 2 * padding;
+        if (width > box.w) box.w = width;
+    }
+    Canvas_set_color(canvas, 0x00, 0x00, 0x00, 0xAA);
+    Canvas_fill_rects(canvas, &box, 1);
+
+    // as few atlas draws as will fit the glyphs
+    SDL_Rect text_rects[MAX_TEXT_QUADS * 2];
+    int text_quad_count = 0;
+    for (int i = 0; i < line_count; i++) {
+        if (text_quad_count + (int) strlen(lines[i]) > MAX_TEXT_QUADS) {
+            Canvas_draw_atlas(canvas, atlas, text_rects, text_quad_count);
+            text_quad_count = 0;
+        }
+        text_quad_count = add_atlas_text_rects(
+            atlas, lines[i], padding, padding + i * atlas->height, text_rects, text_quad_count
+        );
+    }
+    Canvas_draw_atlas(canvas, atlas, text_rects, text_quad_count);
+}
+#endif
+
+// whether the curves are filled in, each closed by its chord, as picked on the command line
+bool fill_curves = false;
+FillRule curve_fill_rule = FILL_NONZERO;
+
+// draws a frame from a snapshot, only touching the render side of the render state
+bool draw_scene(RenderState * state, const SceneSnapshot * scene) {
+    Canvas * const canvas = &state->canvas;
+    const GlyphAtlas * const atlas = &state->atlas;
+
+    PROFILE_BEGIN(PROFILE_STAGE_CULL);
+
+    // clear screen
+    Canvas_set_color(canvas, 0xFF, 0xFF, 0xFF, 0xFF);
+    Canvas_clear(canvas);
+
+    const CurveDocument * const doc = &scene->doc;
+    float * const sliders_value = CurveDocument_weights(doc, scene->active_curve);
+
+    // area of the world on screen, and the larger area in which a point's square would reach the screen
+    const Viewport * const view = &scene->view;
+    BoundingBox view_box = {
+        Viewport_view_to_world(view, (Vec2) { 0, 0 }),
+        Viewport_view_to_world(view, (Vec2) { view->width, view->height }),
+    };
+    float point_margin = (POINT_SIZE / 2 + 1) * view->scale;
+    BoundingBox point_view_box = {
+        { view_box.min.x - point_margin, view_box.min.y - point_margin },
+        { view_box.max.x + point_margin, view_box.max.y + point_margin },
+    };
+
+    /* chunks of curves whose control points are all off screen are skipped without
+       looking at their curves, which for a mapped scene means they aren't even read */
+    const int chunk_count = CurveDocument_chunk_count(doc);
+    int candidate_count = 0;
+    for (int k = 0; k < chunk_count; k++) {
+        if (!BoundingBox_overlaps(doc->chunk_bounds[k], point_view_box)) continue;
+        candidate_count += k == chunk_count - 1 ? doc->count - k * CURVE_CHUNK_SIZE : CURVE_CHUNK_SIZE;
+    }
+
+    /* curves with control points on screen (and the ones of those whose curve is on
+       screen too), and the view positions and squares of their control points */
+    FrameArena * const arena = &state->frame_arena;
+    int * const visible_curves = FrameArena_alloc(arena, sizeof(int) * candidate_count);
+    int * const drawn_curves = FrameArena_alloc(arena, sizeof(int) * candidate_count);
+    Vec2 * const view_points = FrameArena_alloc(arena, sizeof(Vec2) * 4 * candidate_count);
+    SDL_Rect * const point_rects = FrameArena_alloc(arena, sizeof(SDL_Rect) * 4 * candidate_count);
+    int * const control_starts = FrameArena_alloc(arena, sizeof(int) * (candidate_count + 1));
+    if (!visible_curves || !drawn_curves || !view_points || !point_rects || !control_starts) {
+        return false;
+    }
+
+    /* curves entirely off screen are skipped altogether: the control points bound the
+       control polygon and the curve, so only curves whose control points overlap the
+       screen are kept, with their actual point positions calculated */
+    int visible_count = 0;
+    for (int k = 0; k < chunk_count; k++) {
+        if (!BoundingBox_overlaps(doc->chunk_bounds[k], point_view_box)) continue;
+
+        int chunk_end = k == chunk_count - 1 ? doc->count : (k + 1) * CURVE_CHUNK_SIZE;
+        for (int c = k * CURVE_CHUNK_SIZE; c < chunk_end; c++) {
+            Vec2 * points = CurveDocument_points(doc, c);
+            if (!BoundingBox_overlaps(get_points_bounds(points, 4), point_view_box)) continue;
+
+            Viewport_world_to_view_batch(view, points, 4, view_points + 4 * visible_count);
+            visible_curves[visible_count++] = c;
+        }
+    }
+
+    // draw bezier curves, skipping those whose own bounds are off screen
+    int drawn_count = 0;
+    for (int k = 0; k < visible_count; k++) {
+        int c = visible_curves[k];
+        if (BoundingBox_overlaps(doc->bounds[c], view_box)) drawn_curves[drawn_count++] = c;
+    }
+
+    PROFILE_END(PROFILE_STAGE_CULL);
+    PROFILE_BEGIN(PROFILE_STAGE_TESSELLATE);
+
+    /* Polylines are cached in world space per zoom level, tessellated to within the
+       tolerance at the most zoomed in scale of the level, so only curves that changed
+       or are new on screen (or the whole screen, after zooming to another level) need
+       tessellating. Everything else is just transformed. */
+    PolylineCache * const cache = &state->polyline_cache;
+    const int level = floorf(view->log_scale);
+    PolylineCacheEntry ** const drawn_entries = FrameArena_alloc(arena, sizeof(PolylineCacheEntry *) * drawn_count);
+    int * const missing_curves = FrameArena_alloc(arena, sizeof(int) * drawn_count);
+    if (!drawn_entries || !missing_curves || !PolylineCache_prepare(cache, drawn_count)) {
+        return false;
+    }
+
+    // curves being edited mostly just have their polylines updated
+    const float tolerance = CURVE_TOLERANCE * get_actual_scale(level);
+    int missing_count = 0;
+    for (int i = 0; i < drawn_count; i++) {
+        int c = drawn_curves[i];
+        if (!PolylineCache_get(cache, doc, c, level) && !PolylineCache_update(cache, doc, c, level, tolerance)) {
+            missing_curves[missing_count++] = c;
+        }
+    }
+
+    /* to compare against the incorrect normalisation, have tessellation_worker fill
+       each span from fake_rational_cubic_bezier_batch, a block of t values at a time
+       like rational_cubic_bezier_tessellate_span_float, instead of forward differencing */
+    if (missing_count) {
+        TessellationPool * const pool = &state->tessellation;
+        if (!TessellationPool_run(pool, arena, doc->points, doc->weights, missing_curves, missing_count, tolerance) ||
+            !PolylineCache_store(cache, doc, pool, missing_curves, level)
+        ) {
+            return false;
+        }
+    }
+
+    int curve_vertex_count = 0;
+    for (int i = 0; i < drawn_count; i++) {
+        drawn_entries[i] = PolylineCache_get(cache, doc, drawn_curves[i], level);
+        assert(drawn_entries[i]);
+        curve_vertex_count += drawn_entries[i]->count + 1;
+    }
+
+    PROFILE_END(PROFILE_STAGE_TESSELLATE);
+    PROFILE_BEGIN(PROFILE_STAGE_TRANSFORM);
+
+    Vec2 * const curve_vertices = FrameArena_alloc(arena, sizeof(Vec2) * curve_vertex_count);
+    int * const curve_starts = FrameArena_alloc(arena, sizeof(int) * (drawn_count + 1));
+    if (!curve_vertices || !curve_starts) {
+        return false;
+    }
+
+    curve_starts[0] = 0;
+    for (int i = 0; i < drawn_count; i++) {
+        const Vec2 * world_vertices = cache->vertices + drawn_entries[i]->first;
+        Viewport_world_to_view_batch(view, world_vertices, drawn_entries[i]->count + 1, curve_vertices + curve_starts[i]);
+        curve_starts[i + 1] = curve_starts[i] + drawn_entries[i]->count + 1;
+    }
+
+    PROFILE_END(PROFILE_STAGE_TRANSFORM);
+    PROFILE_BEGIN(PROFILE_STAGE_DRAW);
+
+    /* the filled curves go underneath, all as one path so that overlaps follow the
+       fill rule. Culling can't change the fill, as each curve's polygon closes itself */
+    if (fill_curves) {
+        Canvas_set_color(canvas, 0xC0, 0xD0, 0xFF, 0xFF);
+        if (!Canvas_fill_path(canvas, curve_vertices, curve_starts, drawn_count, curve_fill_rule)) {
+            return false;
+        }
+    }
+
+    Canvas_set_color(canvas, 0x00, 0x00, 0xFF, 0xFF);
+    if (!Canvas_draw_polylines(canvas, curve_vertices, curve_starts, drawn_count)) {
+        return false;
+    }
+
+    // draw lines between start/end points and control points, each curve's 4 points being a polyline
+    for (int k = 0; k <= visible_count; k++) {
+        control_starts[k] = 4 * k;
+    }
+    Canvas_set_color(canvas, 0x00, 0xAA, 0xAA, 0xFF);
+    if (!Canvas_draw_polylines(canvas, view_points, control_starts, visible_count)) {
+        return false;
+    }
+
+    // draw start/end/control points, with the end point squares first in the buffer
+    SDL_Rect * const end_point_rects = point_rects;
+    SDL_Rect * const control_point_rects = point_rects + visible_count * 2;
+    for (int k = 0; k < visible_count; k++) {
+        end_point_rects[2 * k] = get_point_rect(view_points[4 * k]);
+        end_point_rects[2 * k + 1] = get_point_rect(view_points[4 * k + 3]);
+        control_point_rects[2 * k] = get_point_rect(view_points[4 * k + 1]);
+        control_point_rects[2 * k + 1] = get_point_rect(view_points[4 * k + 2]);
+    }
+    Canvas_set_color(canvas, 0xFF, 0x00, 0x00, 0xFF);
+    Canvas_fill_rects(canvas, end_point_rects, visible_count * 2);
+    Canvas_set_color(canvas, 0x00, 0xFF, 0x00, 0xFF);
+    Canvas_fill_rects(canvas, control_point_rects, visible_count * 2);
+
+    // draw container for sliders
+    const SliderLayout layout = get_slider_layout(view->width, view->height, state->label_width);
+    Canvas_set_color(canvas, 0x00, 0x00, 0x00, 0xAA);
+    Canvas_fill_rects(canvas, &layout.box, 1);
+
+    PROFILE_END(PROFILE_STAGE_DRAW);
+    PROFILE_BEGIN(PROFILE_STAGE_TEXT);
+
+    // draw slider text, lines and points
+
+    // label glyphs from the atlas, drawn in one call after the loop
+    SDL_Rect text_rects[MAX_TEXT_QUADS * 2];
+    int text_quad_count = 0;
+
+    // slider lines (1 pixel high) and points are all white, so are drawn together after the loop
+    SDL_Rect slider_rects[8];
+
+    for (int i = 0; i < 4; i++) {
+        int current_y = layout.y[i];
+
+        /* slider text */
+
+        if (state->sliders_label_value[i] != sliders_value[i]) {
+            snprintf(state->sliders_label[i], 5, "%.2f", sliders_value[i]);
+            state->sliders_label_value[i] = sliders_value[i];
+        }
+
+        // the layout assumes every label is as wide as "0.00" (monospace font)
+        assert(state->label_width == get_atlas_text_width(atlas, state->sliders_label[i]));
+
+        int text_x = layout.box.x + layout.box.w - layout.inner_padding - state->label_width;
+        int text_y = current_y - atlas->height / 2;
+
+        text_quad_count = add_atlas_text_rects(atlas, state->sliders_label[i], text_x, text_y, text_rects, text_quad_count);
+
+        /* slider lines */
+
+        slider_rects[i] = (SDL_Rect) { layout.x1, current_y, layout.x2 - layout.x1 + 1, 1 };
+
+        /* slider points*/
+
+        int point_x = slider_value_to_x(sliders_value[i], layout.x1, layout.x2);
+        slider_rects[4 + i] = get_point_rect((Vec2) { point_x, current_y });
+    }
+
+    Canvas_draw_atlas(canvas, atlas, text_rects, text_quad_count);
+
+    Canvas_set_color(canvas, 0xFF, 0xFF, 0xFF, 0xFF);
+    Canvas_fill_rects(canvas, slider_rects, 8);
+
+    PROFILE_END(PROFILE_STAGE_TEXT);
+
+#ifdef BEZIER_PROFILE
+    if (SDL_AtomicGet(&profiler.overlay_visible)) {
+        PROFILE_BEGIN(PROFILE_STAGE_OVERLAY);
+        draw_profile_overlay(canvas, atlas);
+        PROFILE_END(PROFILE_STAGE_OVERLAY);
+    }
+#endif
+
+    // update screen
+    PROFILE_BEGIN(PROFILE_STAGE_PRESENT);
+    bool presented = Canvas_present(canvas);
+    PROFILE_END(PROFILE_STAGE_PRESENT);
+
+    return presented;
+}
+
+/* Draws the latest published snapshot, if it hasn't been drawn already. No locks are
+   held while drawing, so events keep being handled (and published) in the meantime.
+   Only ever called from one thread: the render thread, or the headless and replay
+   loops. */
+bool render(RenderState * state) {
+    if (!(SDL_AtomicGet(&state->snapshot_middle) & SNAPSHOT_FRESH)) return true;
+
+    // only render() clears the fresh bit, so the middle snapshot is still fresh here
+    int middle = SDL_AtomicSet(&state->snapshot_middle, state->snapshot_front);
+    state->snapshot_front = middle & ~SNAPSHOT_FRESH;
+
+    PROFILE_BEGIN(PROFILE_STAGE_FRAME);
+    bool success = draw_scene(state, &state->snapshots[state->snapshot_front]);
+    FrameArena_reset(&state->frame_arena);
+    PROFILE_END(PROFILE_STAGE_FRAME);
+#ifdef BEZIER_PROFILE
+    Profiler_end_frame(&profiler);
+#endif
+
+    return success;
+}
+
+void handle_window_event(SDL_Event e, RenderState * state) {
+    if (e.type != SDL_WINDOWEVENT) return;
+
+    switch (e.window.event) {
+        case SDL_WINDOWEVENT_SIZE_CHANGED:
+        {
+            PROFILE_BEGIN(PROFILE_STAGE_MUTEX_WAIT);
+            if (SDL_LockMutex(state->mutex)) assert(0);
+            PROFILE_END(PROFILE_STAGE_MUTEX_WAIT);
+
+            // the render thread draws the new size as soon as it is published
+            Viewport_resize(&state->view, e.window.data1, e.window.data2);
+            state->dirty |= DIRTY_WINDOW;
+            if (!RenderState_publish(state)) assert(0);
+
+            if (SDL_UnlockMutex(state->mutex)) assert(0);
+        } break;
+
+        case SDL_WINDOWEVENT_EXPOSED:
+        {
+            // window contents were lost, so they are drawn again
+            PROFILE_BEGIN(PROFILE_STAGE_MUTEX_WAIT);
+            if (SDL_LockMutex(state->mutex)) assert(0);
+            PROFILE_END(PROFILE_STAGE_MUTEX_WAIT);
+            state->dirty |= DIRTY_WINDOW;
+            if (!RenderState_publish(state)) assert(0);
+            if (SDL_UnlockMutex(state->mutex)) assert(0);
+        } break;
+    }
+}
+
+#ifdef BEZIER_PROFILE
+// F3 shows or hides the profile overlay, and F4 writes the trace to profile_trace_path
+void handle_key_event(SDL_Event e, RenderState * state) {
+    if (e.type != SDL_KEYDOWN || e.key.repeat) return;
+
+    switch (e.key.keysym.sym) {
+        case SDLK_F3:
+        {
+            if (SDL_LockMutex(state->mutex)) assert(0);
+            SDL_AtomicSet(&profiler.overlay_visible, !SDL_AtomicGet(&profiler.overlay_visible));
+            state->dirty |= DIRTY_WINDOW;
+            if (!RenderState_publish(state)) assert(0);
+            if (SDL_UnlockMutex(state->mutex)) assert(0);
+        } break;
+
+        case SDLK_F4:
+        {
+            Profiler_write_trace(&profiler, profile_trace_path);
+        } break;
+    }
+}
+#endif
+
+int handle_window_event_helper(void * state, SDL_Event * e) {
+    handle_window_event(*e, (RenderState *) state);
+    return 1;
+}
+
+// updates render state based on mouse events
+void handle_mouse_event(SDL_Event e, RenderState * state) {
+    if (e.type == SDL_MOUSEBUTTONDOWN ||
+        e.type == SDL_MOUSEBUTTONUP ||
+        e.type == SDL_MOUSEMOTION ||
+        e.type == SDL_MOUSEWHEEL
+    ) {
+        PROFILE_BEGIN(PROFILE_STAGE_EVENTS);
+
+        PROFILE_BEGIN(PROFILE_STAGE_MUTEX_WAIT);
+        if (SDL_LockMutex(state->mutex)) assert(0);
+        PROFILE_END(PROFILE_STAGE_MUTEX_WAIT);
+
+        // taken from the events rather than SDL_GetMouseState, so that replays zoom the same way
+        if (e.type == SDL_MOUSEMOTION) {
+            state->mouse_x = e.motion.x;
+            state->mouse_y = e.motion.y;
+        } else if (e.type != SDL_MOUSEWHEEL) {
+            state->mouse_x = e.button.x;
+            state->mouse_y = e.button.y;
+        }
+
+        switch (e.type) {
             case SDL_MOUSEBUTTONDOWN:
             {
                 int mouse_x = e.button.x;
                 int mouse_y = e.button.y;
 
-                /* TODO could instead handle overlapping points by finding closest
-                point to cursor and applying check_mouse_on_point to just that */
+                /* TODO could instead handle overlapping points by finding closest
+                point to cursor and applying check_mouse_on_point to just that */
+
+                /* Bezier points */
+                if (state->grid.stale && !PointGrid_build(&state->grid, &state->doc)) assert(0);
+
+                int point_index = PointGrid_pick(
+                    &state->grid,
+                    &state->doc,
+                    mouse_x,
+                    mouse_y,
+                    &state->view
+                );
+                if (point_index != -1) {
+                    state->selected = MOUSE_SELECTED_POINT;
+                    state->selected_index = point_index;
+
+                    // sliders switch over to the weights of the picked curve
+                    if (state->active_curve != point_index / 4) {
+                        state->active_curve = point_index / 4;
+                        state->dirty |= DIRTY_SLIDERS;
+                    }
+                }
+
+                if (state->selected != MOUSE_SELECTED_NONE) break;
+
+                /* slider points */
+                SliderLayout layout = get_slider_layout(state->view.width, state->view.height, state->label_width);
+                float * sliders_value = CurveDocument_weights(&state->doc, state->active_curve);
+
+                for (int i = 0; i < 4; i++) {
+                    int slider_x = slider_value_to_x(sliders_value[i], layout.x1, layout.x2);
+                    int slider_y = layout.y[i];
+                    if (check_mouse_on_point(mouse_x, mouse_y, (Vec2) { slider_x, slider_y })) {
+                        state->selected = MOUSE_SELECTED_SLIDER;
+                        state->selected_index = i;
+                        break;
+                    }
+                }
+
+                if (state->selected != MOUSE_SELECTED_NONE) break;
+
+                /* curves, picking the nearest within a few pixels */
+                Vec2 mouse_world_pos = Viewport_view_to_world(&state->view, (Vec2) { mouse_x, mouse_y });
+                int curve = CurveDocument_pick_curve(
+                    &state->doc,
+                    mouse_world_pos,
+                    CURVE_PICK_DISTANCE * state->view.scale,
+                    CURVE_TOLERANCE * state->view.scale
+                );
+                if (curve != -1) {
+                    state->selected = MOUSE_SELECTED_CURVE;
+                    state->selected_index = curve;
+
+                    if (state->active_curve != curve) {
+                        state->active_curve = curve;
+                        state->dirty |= DIRTY_SLIDERS;
+                    }
+                    break;
+                }
+
+                // TODO could make the slider container opaque
+                state->selected = MOUSE_SELECTED_BACKGROUND;
+
+            } break;
+
+            case SDL_MOUSEBUTTONUP:
+            {
+                // moved points are put back into the grid once the drag is over
+                if (state->selected == MOUSE_SELECTED_POINT && state->grid.stale) {
+                    if (!PointGrid_build(&state->grid, &state->doc)) assert(0);
+                }
+
+                state->selected = MOUSE_SELECTED_NONE;
+            } break;
+
+            case SDL_MOUSEMOTION:
+            {
+                switch (state->selected) {
+                    case MOUSE_SELECTED_POINT:
+                    {
+                        Vec2 mouse_pos = { e.motion.x, e.motion.y };
+                        Vec2 world_pos = Viewport_view_to_world(&state->view, mouse_pos);
+                        if (!CurveDocument_set_point(&state->doc, state->selected_index, world_pos)) assert(0);
+                        state->grid.stale = true;
+                        state->dirty |= DIRTY_POINTS;
+                    } break;
+
+                    case MOUSE_SELECTED_SLIDER:
+                    {
+                        SliderLayout layout = get_slider_layout(
+                            state->view.width, state->view.height, state->label_width
+                        );
+                        int x1 = layout.x1;
+                        int x2 = layout.x2;
+
+                        int slider_x = e.motion.x;
+                        if (slider_x < x1) slider_x = x1;
+                        if (slider_x > x2) slider_x = x2;
+
+                        bool success = CurveDocument_set_weight(
+                            &state->doc, state->active_curve, state->selected_index, slider_x_to_value(slider_x, x1, x2)
+                        );
+                        if (!success) assert(0);
+                        state->dirty |= DIRTY_SLIDERS;
+                    } break;
+
+                    case MOUSE_SELECTED_BACKGROUND:
+                    {
+                        Vec2 offset = { e.motion.xrel, e.motion.yrel };
+
+                        /* Adjust for scaling */
+                        Vec2 scaled_offset = Vec2_scale(offset, state->view.scale);
+
+                        Viewport_set(&state->view, Vec2_sub(state->view.center, scaled_offset), state->view.log_scale);
+                        state->dirty |= DIRTY_VIEWPORT;
+                    } break;
+
+                    case MOUSE_SELECTED_CURVE:
+                        // clicking a curve only picks it for the sliders
+                        break;
+
+                    default:
+                        assert(state->selected == MOUSE_SELECTED_NONE); // only other option
+                }
+            } break;
+
+            case SDL_MOUSEWHEEL:
+            {
+                Vec2 mouse_pos = { state->mouse_x, state->mouse_y };
+
+                Vec2 mouse_world_pos = Viewport_view_to_world(&state->view, mouse_pos);
+
+                float scale_change = -e.wheel.y;
+
+                /* Update viewport center coordinates so that coordinate under the
+                   mouse position remains under the mouse position after scaling */
+
+                Vec2 center = Vec2_add(
+                    Vec2_scale(state->view.center, get_actual_scale(scale_change)),
+                    Vec2_scale(mouse_world_pos, 1 - get_actual_scale(scale_change))
+                );
+
+                Viewport_set(&state->view, center, state->view.log_scale + scale_change);
+                state->dirty |= DIRTY_VIEWPORT;
+
+            } break;
+
+            default:
+                assert(0);
+        }
+
+        // hand any changes over to render()
+        if (state->dirty && !RenderState_publish(state)) assert(0);
+
+        if (SDL_UnlockMutex(state->mutex)) assert(0);
+
+        PROFILE_END(PROFILE_STAGE_EVENTS);
+    }
+}
+
+/* Input recordings hold the events handled by the main loop, each with the time
+   since recording started, plus a marker after each pass of the loop, where a frame
+   may be drawn. Replaying them through the same handlers, drawing at the same points,
+   goes through the same states as the recorded session (given the same scene), with
+   one exception: live window events are handled by the event watch as SDL pushes
+   them, ahead of whatever is still queued, while a replay handles them where they sit
+   in the queue. Around resizes the two can see events in a different order. The
+   header holds the window size and mouse position at the start. Like scene files,
+   everything is in native byte order. */
+#define RECORDING_MAGIC 0x43455242 // "BREC" when read little endian
+#define RECORDING_VERSION 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t mouse_x;
+    int32_t mouse_y;
+} RecordingHeader;
+
+// type of the marker at the end of a main loop pass, which isn't an SDL event type
+#define RECORDED_FRAME 0
+
+// an event with just the fields the handlers use, which depend on the type
+typedef struct {
+    uint32_t time_ms;
+    uint32_t type;
+    int32_t data[4];
+} RecordedEvent;
+
+typedef struct {
+    FILE * file;
+    double start;
+} InputRecorder;
+
+// packs the fields of an event the handlers use, returning false for events that aren't recorded
+static bool RecordedEvent_pack(const SDL_Event * e, RecordedEvent * record) {
+    switch (e->type) {
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            *record = (RecordedEvent) { 0, e->type, { e->button.x, e->button.y, e->button.button } };
+            return true;
+
+        case SDL_MOUSEMOTION:
+            *record = (RecordedEvent) { 0, e->type, { e->motion.x, e->motion.y, e->motion.xrel, e->motion.yrel } };
+            return true;
+
+        case SDL_MOUSEWHEEL:
+            *record = (RecordedEvent) { 0, e->type, { e->wheel.x, e->wheel.y } };
+            return true;
+
+        case SDL_WINDOWEVENT:
+            *record = (RecordedEvent) { 0, e->type, { e->window.event, e->window.data1, e->window.data2 } };
+            return true;
+
+        case SDL_KEYDOWN:
+            *record = (RecordedEvent) { 0, e->type, { e->key.keysym.sym, e->key.repeat } };
+            return true;
+    }
+    return false;
+}
+
+static SDL_Event RecordedEvent_unpack(const RecordedEvent * record) {
+    SDL_Event e = {0};
+    e.type = record->type;
+    switch (record->type) {
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            e.button.x = record->data[0];
+            e.button.y = record->data[1];
+            e.button.button = record->data[2];
+            break;
+
+        case SDL_MOUSEMOTION:
+            e.motion.x = record->data[0];
+            e.motion.y = record->data[1];
+            e.motion.xrel = record->data[2];
+            e.motion.yrel = record->data[3];
+            break;
+
+        case SDL_MOUSEWHEEL:
+            e.wheel.x = record->data[0];
+            e.wheel.y = record->data[1];
+            break;
+
+        case SDL_WINDOWEVENT:
+            e.window.event = record->data[0];
+            e.window.data1 = record->data[1];
+            e.window.data2 = record->data[2];
+            break;
+
+        case SDL_KEYDOWN:
+            e.key.keysym.sym = record->data[0];
+            e.key.repeat = record->data[1];
+            break;
+    }
+    return e;
+}
+
+bool InputRecorder_open(InputRecorder * recorder, const char * path, int width, int height, int mouse_x, int mouse_y) {
+    recorder->file = fopen(path, "wb");
+    if (!recorder->file) {
+        printf("Could not open %s for writing\n", path);
+        return false;
+    }
+
+    RecordingHeader header = { RECORDING_MAGIC, RECORDING_VERSION, width, height, mouse_x, mouse_y };
+    if (fwrite(&header, sizeof(header), 1, recorder->file) != 1) {
+        printf("Failed to write %s\n", path);
+        return false;
+    }
+
+    recorder->start = get_seconds();
+    return true;
+}
+
+static bool InputRecorder_write(InputRecorder * recorder, RecordedEvent record) {
+    record.time_ms = (get_seconds() - recorder->start) * 1e3;
+    if (fwrite(&record, sizeof(record), 1, recorder->file) != 1) {
+        printf("Failed to write input recording\n");
+        return false;
+    }
+    return true;
+}
+
+// records an event, if it is one the handlers use
+bool InputRecorder_add_event(InputRecorder * recorder, const SDL_Event * e) {
+    RecordedEvent record;
+    if (!RecordedEvent_pack(e, &record)) return true;
+    return InputRecorder_write(recorder, record);
+}
+
+bool InputRecorder_add_frame(InputRecorder * recorder) {
+    return InputRecorder_write(recorder, (RecordedEvent) { 0, RECORDED_FRAME });
+}
+
+bool InputRecorder_close(InputRecorder * recorder) {
+    bool success = fclose(recorder->file) == 0;
+    recorder->file = NULL;
+    if (!success) printf("Failed to write input recording\n");
+    return success;
+}
+
+// everything needed to draw frames with the software renderer, without a display
+typedef struct {
+    TTF_Font * font;
+    SoftwareRenderer software;
+    RenderState state;
+} HeadlessContext;
+
+bool HeadlessContext_init(HeadlessContext * context, int width, int height) {
+    *context = (HeadlessContext) {0};
+
+    // no subsystems needed: the software renderer only uses threads and surfaces
+    if (SDL_Init(0) < 0) {
+        printf("SDL could not initialise: %s\n", SDL_GetError());
+        return false;
+    }
+
+    if (TTF_Init()) {
+        printf("SDL_ttf could not initialize: %s\n", TTF_GetError());
+        return false;
+    }
+
+    context->font = TTF_OpenFont(FONT_PATH, FONT_SIZE);
+    if (!context->font) {
+        printf("Could not open font at path %s: %s\n", FONT_PATH, TTF_GetError());
+        return false;
+    }
+
+    if (!SoftwareRenderer_init(&context->software, width, height)) {
+        return false;
+    }
+
+    if (!RenderState_init(&context->state, (Canvas) { NULL, &context->software }, context->font)) {
+        printf("Failed to intialise render state\n");
+        return false;
+    }
+
+    return true;
+}
+
+void HeadlessContext_cleanup(HeadlessContext * context) {
+    RenderState_cleanup(&context->state);
+    SoftwareRenderer_cleanup(&context->software);
+    TTF_CloseFont(context->font);
+
+    TTF_Quit();
+    SDL_Quit();
+}
+
+/* Draws a single frame of the default document, or of a scene file if scene_path isn't
+   NULL, with the software renderer and writes it out as a PPM, without needing a display */
+int render_headless(const char * output_path, const char * scene_path) {
+    int result = 1;
+    HeadlessContext context;
+
+    if (!HeadlessContext_init(&context, INITIAL_SCREEN_WIDTH, INITIAL_SCREEN_HEIGHT)) {
+        goto headless_cleanup;
+    }
+
+    if (scene_path && !RenderState_load_scene(&context.state, scene_path)) {
+        goto headless_cleanup;
+    }
+
+    if (!render(&context.state)) {
+        printf("Failed to render frame\n");
+        goto headless_cleanup;
+    }
+
+    if (SoftwareRenderer_write_ppm(&context.software, output_path)) {
+        result = 0;
+    }
+
+headless_cleanup:
+    HeadlessContext_cleanup(&context);
+
+    return result;
+}
+
+/* Benchmarks, run with --bench. Each result is printed as a line of JSON so runs can
+   be compared by scripts. */
+
+// keeps benchmarked results alive so the work isn't optimised away
+volatile float benchmark_sink;
+
+void print_benchmark_result(const char * name, const char * unit, double value) {
+    printf("{\"benchmark\": \"%s\", \"unit\": \"%s\", \"value\": %.6g}\n", name, unit, value);
+    fflush(stdout);
+}
+
+// random curve within a square of the given size, with weights across the slider range
+void get_random_curve(float size, Vec2 points[4], float weights[4]) {
+    for (int i = 0; i < 4; i++) {
+        points[i] = (Vec2) { size * rand() / RAND_MAX - size / 2, size * rand() / RAND_MAX - size / 2 };
+        weights[i] = SLIDER_MIN + (SLIDER_MAX - SLIDER_MIN) * rand() / RAND_MAX;
+    }
+}
+
+#define BENCHMARK_CURVES 1024
+#define BENCHMARK_SAMPLES 1024
+
+int run_benchmarks(void) {
+    srand(1);
+
+    static Vec2 points[BENCHMARK_CURVES][4];
+    static float weights[BENCHMARK_CURVES][4];
+    for (int c = 0; c < BENCHMARK_CURVES; c++) {
+        get_random_curve(INITIAL_SCREEN_HEIGHT, points[c], weights[c]);
+    }
+
+    static double ts[BENCHMARK_SAMPLES];
+    static float xs[BENCHMARK_SAMPLES];
+    static float ys[BENCHMARK_SAMPLES];
+    static float float_ts[BENCHMARK_SAMPLES];
+    for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+        ts[i] = (double) i / (BENCHMARK_SAMPLES - 1);
+        float_ts[i] = ts[i];
+    }
+
+    const int repeats = 16;
+    const double samples = (double) repeats * BENCHMARK_CURVES * BENCHMARK_SAMPLES;
+    double start;
+
+    /* evaluation throughput */
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+                benchmark_sink += cubic_bezier(ts[i], points[c]).x;
+            }
+        }
+    }
+    print_benchmark_result("cubic_bezier", "samples/s", samples / (get_seconds() - start));
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+                benchmark_sink += rational_cubic_bezier(ts[i], points[c], weights[c]).x;
+            }
+        }
+    }
+    print_benchmark_result("rational_cubic_bezier", "samples/s", samples / (get_seconds() - start));
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            cubic_bezier_batch(ts, BENCHMARK_SAMPLES, points[c], xs, ys);
+            benchmark_sink += xs[c % BENCHMARK_SAMPLES];
+        }
+    }
+    print_benchmark_result("cubic_bezier_batch", "samples/s", samples / (get_seconds() - start));
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            rational_cubic_bezier_batch(ts, BENCHMARK_SAMPLES, points[c], weights[c], xs, ys);
+            benchmark_sink += xs[c % BENCHMARK_SAMPLES];
+        }
+    }
+    print_benchmark_result("rational_cubic_bezier_batch", "samples/s", samples / (get_seconds() - start));
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            rational_cubic_bezier_batch_float(float_ts, BENCHMARK_SAMPLES, points[c], weights[c], xs, ys);
+            benchmark_sink += xs[c % BENCHMARK_SAMPLES];
+        }
+    }
+    print_benchmark_result("rational_cubic_bezier_batch_float", "samples/s", samples / (get_seconds() - start));
+
+    // the same curves with their weights made equal, then symmetric, through the specialized kernels
+    static float pattern_weights[3][BENCHMARK_CURVES][4];
+    const char * pattern_names[3] = { "polynomial", "symmetric", "general" };
+    for (int c = 0; c < BENCHMARK_CURVES; c++) {
+        for (int i = 0; i < 4; i++) {
+            pattern_weights[WEIGHTS_POLYNOMIAL][c][i] = weights[c][0];
+            pattern_weights[WEIGHTS_SYMMETRIC][c][i] = weights[c][i == 0 || i == 3 ? 0 : 1];
+            pattern_weights[WEIGHTS_GENERAL][c][i] = weights[c][i];
+        }
+    }
+    for (int p = 0; p < 3; p++) {
+        char name[64];
+        start = get_seconds();
+        for (int r = 0; r < repeats; r++) {
+            for (int c = 0; c < BENCHMARK_CURVES; c++) {
+                rational_cubic_bezier_batch(ts, BENCHMARK_SAMPLES, points[c], pattern_weights[p][c], xs, ys);
+                benchmark_sink += xs[c % BENCHMARK_SAMPLES];
+            }
+        }
+        snprintf(name, sizeof(name), "rational_cubic_bezier_batch_%s", pattern_names[p]);
+        print_benchmark_result(name, "samples/s", samples / (get_seconds() - start));
+    }
+
+    /* tessellation, with segment counts picked as render() does */
+
+    static Vec2 curve_points[MAX_CURVE_SEGMENTS + 1];
+    long long total_segments = 0;
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            int segments = rational_cubic_bezier_segment_count(points[c], weights[c], CURVE_TOLERANCE);
+            rational_cubic_bezier_tessellate(points[c], weights[c], segments, curve_points);
+            benchmark_sink += curve_points[segments / 2].x;
+            total_segments += segments;
+        }
+    }
+    double tessellate_seconds = get_seconds() - start;
+    print_benchmark_result("tessellate", "ns/curve", tessellate_seconds * 1e9 / (repeats * BENCHMARK_CURVES));
+    print_benchmark_result("tessellate", "samples/s", total_segments / tessellate_seconds);
+
+    // equal weights need fewer segments too, so compare these by samples/s
+    long long polynomial_segments = 0;
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            float * curve_weights = pattern_weights[WEIGHTS_POLYNOMIAL][c];
+            int segments = rational_cubic_bezier_segment_count(points[c], curve_weights, CURVE_TOLERANCE);
+            rational_cubic_bezier_tessellate(points[c], curve_weights, segments, curve_points);
+            benchmark_sink += curve_points[segments / 2].x;
+            polynomial_segments += segments;
+        }
+    }
+    print_benchmark_result("tessellate_polynomial", "samples/s", polynomial_segments / (get_seconds() - start));
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            int segments = rational_cubic_bezier_segment_count(points[c], weights[c], CURVE_TOLERANCE);
+            rational_cubic_bezier_tessellate_span_float(points[c], weights[c], segments, 0, segments, curve_points);
+            benchmark_sink += curve_points[segments / 2].x;
+        }
+    }
+    tessellate_seconds = get_seconds() - start;
+    print_benchmark_result("tessellate_float", "ns/curve", tessellate_seconds * 1e9 / (repeats * BENCHMARK_CURVES));
+    print_benchmark_result("tessellate_float", "samples/s", total_segments / tessellate_seconds);
+
+    // the same curves through the tessellation pool, first on one thread then on all of them
+    static int pool_curves[BENCHMARK_CURVES];
+    for (int c = 0; c < BENCHMARK_CURVES; c++) {
+        pool_curves[c] = c;
+    }
+    TessellationPool pool;
+    if (!TessellationPool_init(&pool)) {
+        TessellationPool_cleanup(&pool);
+        return 1;
+    }
+    FrameArena arena;
+    FrameArena_init(&arena);
+    const int pool_workers[2] = { 1, pool.worker_count };
+    for (int p = 0; p < 2; p++) {
+        pool.worker_count = pool_workers[p];
+        start = get_seconds();
+        for (int r = 0; r < repeats; r++) {
+            bool success = TessellationPool_run(
+                &pool, &arena, points[0], weights[0], pool_curves, BENCHMARK_CURVES, CURVE_TOLERANCE
+            );
+            if (!success) {
+                FrameArena_cleanup(&arena);
+                TessellationPool_cleanup(&pool);
+                return 1;
+            }
+            benchmark_sink += pool.vertices[r].x;
+            FrameArena_reset(&arena);
+        }
+        print_benchmark_result(
+            p == 0 ? "tessellate_pool_1_thread" : "tessellate_pool_all_threads",
+            "ns/curve",
+            (get_seconds() - start) * 1e9 / (repeats * BENCHMARK_CURVES)
+        );
+    }
+    FrameArena_cleanup(&arena);
+    TessellationPool_cleanup(&pool);
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            benchmark_sink += rational_cubic_bezier_bounds(points[c], weights[c]).max.x;
+        }
+    }
+    print_benchmark_result("bounds", "ns/curve", (get_seconds() - start) * 1e9 / (repeats * BENCHMARK_CURVES));
+
+    /* NURBS, through every benchmark control point with uniform knots */
+
+    const int nurbs_count = BENCHMARK_CURVES * 4;
+    static double nurbs_knots[BENCHMARK_CURVES * 4 + NURBS_MAX_DEGREE + 1];
+    static double nurbs_ts[BENCHMARK_SAMPLES * 16];
+    static float nurbs_xs[BENCHMARK_SAMPLES * 16];
+    static float nurbs_ys[BENCHMARK_SAMPLES * 16];
+    const int nurbs_samples = BENCHMARK_SAMPLES * 16;
+    const int nurbs_degrees[2] = { 3, 5 };
+    const char * nurbs_names[2][3] = {
+        { "nurbs_evaluate_degree_3", "nurbs_evaluate_batch_degree_3", "nurbs_to_bezier_degree_3" },
+        { "nurbs_evaluate_degree_5", "nurbs_evaluate_batch_degree_5", "nurbs_to_bezier_degree_5" },
+    };
+    for (int d = 0; d < 2; d++) {
+        NurbsCurve nurbs = { nurbs_degrees[d], nurbs_count, points[0], weights[0], nurbs_knots };
+        for (int i = 0; i < nurbs_count + nurbs.degree + 1; i++) {
+            nurbs_knots[i] = i;
+        }
+        for (int i = 0; i < nurbs_samples; i++) {
+            nurbs_ts[i] = nurbs.degree + (double) (nurbs_count - nurbs.degree) * i / (nurbs_samples - 1);
+        }
+
+        start = get_seconds();
+        for (int r = 0; r < repeats; r++) {
+            for (int i = 0; i < nurbs_samples; i++) {
+                benchmark_sink += NurbsCurve_evaluate(&nurbs, nurbs_ts[i]).x;
+            }
+        }
+        print_benchmark_result(nurbs_names[d][0], "samples/s", (double) repeats * nurbs_samples / (get_seconds() - start));
+
+        start = get_seconds();
+        for (int r = 0; r < repeats; r++) {
+            NurbsCurve_evaluate_batch(&nurbs, nurbs_ts, nurbs_samples, nurbs_xs, nurbs_ys);
+            benchmark_sink += nurbs_xs[r];
+        }
+        print_benchmark_result(nurbs_names[d][1], "samples/s", (double) repeats * nurbs_samples / (get_seconds() - start));
+
+        CurveDocument nurbs_doc;
+        CurveDocument_init(&nurbs_doc);
+        start = get_seconds();
+        for (int r = 0; r < repeats; r++) {
+            nurbs_doc.count = 0;
+            if (!CurveDocument_add_nurbs(&nurbs_doc, &nurbs, 0.01f)) {
+                CurveDocument_cleanup(&nurbs_doc);
+                return 1;
+            }
+        }
+        print_benchmark_result(
+            nurbs_names[d][2], "ns/span", (get_seconds() - start) * 1e9 / (repeats * (nurbs_count - nurbs.degree))
+        );
+        benchmark_sink += nurbs_doc.count;
+        CurveDocument_cleanup(&nurbs_doc);
+    }
+
+    /* curve queries */
 
-                /* Bezier points */
-                for (int i = 0; i < 4; i++) {
-                    Vec2 point_position = world_to_view_pos(
-                        state->points[i],
-                        state->view_center,
-                        state->view_log_scale,
-                        state->window_width,
-                        state->window_height
-                    );
-                    if (check_mouse_on_point(mouse_x, mouse_y, point_position)) {
-                        state->selected = MOUSE_SELECTED_POINT;
-                        state->selected_index = i;
-                        break;
-                    }
+    const int queries = repeats * BENCHMARK_CURVES;
+    const float query_tolerance = CURVE_TOLERANCE;
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            Vec2 p = points[(c + r + 1) % BENCHMARK_CURVES][r % 4];
+            benchmark_sink += rational_cubic_bezier_nearest(points[c], weights[c], p, INFINITY, query_tolerance).t;
+        }
+    }
+    print_benchmark_result("nearest_point", "ns/query", (get_seconds() - start) * 1e9 / queries);
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            CurvePoint hits[3];
+            Vec2 origin = points[(c + r + 1) % BENCHMARK_CURVES][0];
+            Vec2 direction = { cosf(c + r), sinf(c + r) };
+            int hit_count = rational_cubic_bezier_ray_intersections(points[c], weights[c], origin, direction, hits);
+            benchmark_sink += hit_count ? hits[0].t : 0;
+        }
+    }
+    print_benchmark_result("ray_intersections", "ns/query", (get_seconds() - start) * 1e9 / queries);
+
+    int intersection_count = 0;
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            int other = (c + r + 1) % BENCHMARK_CURVES;
+            CurveIntersection hits[MAX_CURVE_INTERSECTIONS];
+            intersection_count += rational_cubic_bezier_intersections(
+                points[c], weights[c], points[other], weights[other], query_tolerance, hits
+            );
+        }
+    }
+    print_benchmark_result("curve_intersections", "ns/pair", (get_seconds() - start) * 1e9 / queries);
+    benchmark_sink += intersection_count;
+
+    // all pairs over a scene laid out like generate_scene's
+    CurveDocument query_doc;
+    CurveDocument_init(&query_doc);
+    const int query_curves = BENCHMARK_CURVES * 16;
+    const float query_area = 100 * sqrtf(query_curves);
+    for (int c = 0; c < query_curves; c++) {
+        Vec2 curve_points[4];
+        float curve_weights[4];
+        get_random_curve(100, curve_points, curve_weights);
+        Vec2 offset = { (float) rand() / RAND_MAX * query_area, (float) rand() / RAND_MAX * query_area };
+        for (int i = 0; i < 4; i++) {
+            curve_points[i] = Vec2_add(curve_points[i], offset);
+        }
+        if (!CurveDocument_add_curve(&query_doc, curve_points, curve_weights)) {
+            CurveDocument_cleanup(&query_doc);
+            return 1;
+        }
+    }
+
+    CurveIntersection * intersections = NULL;
+    int intersections_capacity = 0;
+    start = get_seconds();
+    intersection_count = CurveDocument_find_intersections(
+        &query_doc, query_tolerance, &intersections, &intersections_capacity
+    );
+    print_benchmark_result("find_intersections", "ms/scene", (get_seconds() - start) * 1e3);
+    print_benchmark_result("find_intersections", "intersections", intersection_count);
+    free(intersections);
+
+    start = get_seconds();
+    for (int q = 0; q < queries; q++) {
+        Vec2 p = { (float) rand() / RAND_MAX * query_area, (float) rand() / RAND_MAX * query_area };
+        benchmark_sink += CurveDocument_pick_curve(&query_doc, p, 4, query_tolerance);
+    }
+    print_benchmark_result("pick_curve", "ns/query", (get_seconds() - start) * 1e9 / queries);
+    CurveDocument_cleanup(&query_doc);
+
+    /* arc length */
+
+    static ArcLengthTable tables[BENCHMARK_CURVES];
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            ArcLengthTable_build(&tables[c], points[c], weights[c]);
+        }
+    }
+    print_benchmark_result("arc_length_table", "ns/curve", (get_seconds() - start) * 1e9 / (repeats * BENCHMARK_CURVES));
+
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            float length = ArcLengthTable_length(&tables[c]);
+            for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+                benchmark_sink += ArcLengthTable_t_at(&tables[c], length * float_ts[i]);
+            }
+        }
+    }
+    print_benchmark_result("arc_length_t_at", "lookups/s", samples / (get_seconds() - start));
+
+    // points 1 unit apart, from the tables, against finding them along a polyline fine enough to be as close
+    static Vec2 uniform_points[BENCHMARK_SAMPLES * 4];
+    long long uniform_samples = 0;
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            int count = ArcLengthTable_sample_count(&tables[c], 1);
+            if (count > BENCHMARK_SAMPLES * 4) count = BENCHMARK_SAMPLES * 4;
+            rational_cubic_bezier_sample_uniform(&tables[c], points[c], weights[c], 1, count, uniform_points);
+            benchmark_sink += uniform_points[count / 2].x;
+            uniform_samples += count;
+        }
+    }
+    print_benchmark_result("sample_uniform", "samples/s", uniform_samples / (get_seconds() - start));
+
+    static Vec2 dense_points[BENCHMARK_SAMPLES * 16 + 1];
+    const int dense_segments = BENCHMARK_SAMPLES * 16;
+    start = get_seconds();
+    for (int r = 0; r < repeats; r++) {
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            rational_cubic_bezier_tessellate(points[c], weights[c], dense_segments, dense_points);
+            // walk the polyline, dropping a point every unit
+            float next = 0;
+            float walked = 0;
+            int count = 0;
+            for (int i = 0; i < dense_segments && count < BENCHMARK_SAMPLES * 4; i++) {
+                Vec2 d = Vec2_sub(dense_points[i + 1], dense_points[i]);
+                float step = sqrtf(d.x * d.x + d.y * d.y);
+                while (walked + step >= next && count < BENCHMARK_SAMPLES * 4) {
+                    float u = step > 0 ? (next - walked) / step : 0;
+                    uniform_points[count++] = Vec2_add(dense_points[i], Vec2_scale(d, u));
+                    next += 1;
                 }
+                walked += step;
+            }
+            benchmark_sink += uniform_points[count / 2].x;
+        }
+    }
+    print_benchmark_result("sample_uniform_dense", "samples/s", uniform_samples / (get_seconds() - start));
+
+    /* the same through the cache: building every table on the first pass, then only
+       the table of the one curve edited before each later pass */
+    CurveDocument arc_doc;
+    ArcLengthCache arc_cache = {0};
+    static int arc_curves[BENCHMARK_CURVES];
+    static int arc_starts[BENCHMARK_CURVES + 1];
+    Vec2 * arc_points = NULL;
+    int arc_points_capacity = 0;
+    bool arc_success = CurveDocument_init(&arc_doc);
+    for (int c = 0; c < BENCHMARK_CURVES && arc_success; c++) {
+        arc_success = CurveDocument_add_curve(&arc_doc, points[c], weights[c]);
+        arc_curves[c] = c;
+    }
+    for (int pass = 0; pass < 2 && arc_success; pass++) {
+        uniform_samples = 0;
+        start = get_seconds();
+        for (int r = 0; r < (pass == 0 ? 1 : repeats) && arc_success; r++) {
+            if (pass == 1) {
+                Vec2 * edited = CurveDocument_points(&arc_doc, r % BENCHMARK_CURVES);
+                edited[1].x += r % 2 ? 1 : -1;
+            }
+            arc_success = ArcLengthCache_sample_uniform(
+                &arc_cache, &arc_doc, arc_curves, BENCHMARK_CURVES, 1, &arc_points, &arc_points_capacity, arc_starts
+            );
+            uniform_samples += arc_starts[BENCHMARK_CURVES];
+        }
+        if (arc_success) {
+            benchmark_sink += arc_points[arc_starts[BENCHMARK_CURVES] / 2].x;
+            print_benchmark_result(
+                pass == 0 ? "sample_uniform_cache_cold" : "sample_uniform_cache_one_edit",
+                "samples/s",
+                uniform_samples / (get_seconds() - start)
+            );
+        }
+    }
+    free(arc_points);
+    ArcLengthCache_cleanup(&arc_cache);
+    CurveDocument_cleanup(&arc_doc);
+    if (!arc_success) return 1;
+
+    /* view transforms */
+
+    const double transforms = (double) repeats * BENCHMARK_CURVES * 4 * 64;
+    static Vec2 view_points[BENCHMARK_CURVES][4];
+    Viewport view;
+    Viewport_resize(&view, 640, 480);
+
+    start = get_seconds();
+    for (int r = 0; r < repeats * 64; r++) {
+        Viewport_set(&view, (Vec2) { r, -r }, r % 20 - 10);
+        for (int c = 0; c < BENCHMARK_CURVES; c++) {
+            for (int i = 0; i < 4; i++) {
+                benchmark_sink += Viewport_world_to_view(&view, points[c][i]).x;
+            }
+        }
+    }
+    print_benchmark_result("world_to_view", "points/s", transforms / (get_seconds() - start));
 
-                if (state->selected != MOUSE_SELECTED_NONE) break;
+    start = get_seconds();
+    for (int r = 0; r < repeats * 64; r++) {
+        Viewport_set(&view, (Vec2) { r, -r }, r % 20 - 10);
+        Viewport_world_to_view_batch(&view, points[0], BENCHMARK_CURVES * 4, view_points[0]);
+        benchmark_sink += view_points[r % BENCHMARK_CURVES][0].x;
+    }
+    print_benchmark_result("world_to_view_batch", "points/s", transforms / (get_seconds() - start));
 
-                /* slider points */
-                int x1 = state->sliders_x1;
-                int x2 = state->sliders_x2;
+    /* filled paths on a 4K framebuffer. Recording takes about 1 ms, and on one core
+       presenting takes about 70-100 ms: clipping and binning about 15 ms, accumulating
+       about 35-45 ms and filling the spans about 20-35 ms. Everything but recording is
+       split across threads, so a few milliseconds a frame needs a dozen or more cores */
 
-                for (int i = 0; i < 4; i++) {
-                    int slider_x = slider_value_to_x(state->sliders_value[i], x1, x2);
-                    int slider_y = state->sliders_y[i];
-                    if (check_mouse_on_point(mouse_x, mouse_y, (Vec2) { slider_x, slider_y })) {
-                        state->selected = MOUSE_SELECTED_SLIDER;
-                        state->selected_index = i;
-                        break;
-                    }
+    SoftwareRenderer fill_software;
+    if (!SoftwareRenderer_init(&fill_software, 3840, 2160)) {
+        SoftwareRenderer_cleanup(&fill_software);
+        return 1;
+    }
+    Viewport fill_view;
+    Viewport_set(&fill_view, (Vec2) { 0, 0 }, 0);
+    Viewport_resize(&fill_view, fill_software.width, fill_software.height);
+
+    // closed paths of 4 curves 400 pixels across, each pixel being covered by several of them
+    const int fill_paths = 2048;
+    const int path_curves = 4;
+    static int fill_starts[2048 + 1];
+    Vec2 path_points[4 * 4];
+    float path_weights[4 * 4];
+    Vec2 * fill_points = NULL;
+    int fill_points_capacity = 0;
+    int fill_point_count = 0;
+
+    start = get_seconds();
+    fill_starts[0] = 0;
+    for (int p = 0; p < fill_paths; p++) {
+        Vec2 center = {
+            ((float) rand() / RAND_MAX - 0.5f) * fill_software.width,
+            ((float) rand() / RAND_MAX - 0.5f) * fill_software.height,
+        };
+        for (int c = 0; c < path_curves; c++) {
+            get_random_curve(400, path_points + 4 * c, path_weights + 4 * c);
+            for (int i = 0; i < 4; i++) {
+                path_points[4 * c + i] = Vec2_add(path_points[4 * c + i], center);
+            }
+        }
+        // join the curves end to end
+        for (int c = 0; c < path_curves; c++) {
+            path_points[4 * c + 3] = path_points[4 * ((c + 1) % path_curves)];
+        }
+
+        if (!rational_cubic_path_flatten(&fill_view, path_points, path_weights, path_curves,
+                                         &fill_points, &fill_points_capacity, &fill_point_count)) {
+            free(fill_points);
+            SoftwareRenderer_cleanup(&fill_software);
+            return 1;
+        }
+        fill_starts[p + 1] = fill_point_count;
+    }
+    print_benchmark_result("fill_flatten", "ms/frame", (get_seconds() - start) * 1e3);
+    print_benchmark_result("fill_flatten", "edges/frame", fill_point_count);
+
+    const char * fill_rule_names[2] = { "nonzero", "evenodd" };
+    const int fill_threads[2] = { fill_software.thread_count, 1 };
+    const int fill_frames = 8;
+    for (int t = 0; t < 2; t++) {
+        fill_software.thread_count = fill_threads[t];
+        for (int rule = 0; rule < 2; rule++) {
+            double record_seconds = 0;
+            start = get_seconds();
+            for (int f = 0; f < fill_frames; f++) {
+                double record_start = get_seconds();
+                fill_software.color = (SDL_Color) { 0xFF, 0xFF, 0xFF, 0xFF };
+                bool success = SoftwareRenderer_add_command(&fill_software, SOFTWARE_CLEAR, 0, 0);
+                fill_software.color = (SDL_Color) { 0xC0, 0xD0, 0xFF, 0xFF };
+                success = success && SoftwareRenderer_add_fill(
+                    &fill_software, fill_points, fill_starts, fill_paths, (FillRule) rule
+                );
+                if (!success) {
+                    free(fill_points);
+                    SoftwareRenderer_cleanup(&fill_software);
+                    return 1;
                 }
+                record_seconds += get_seconds() - record_start;
+                if (!SoftwareRenderer_present(&fill_software)) {
+                    free(fill_points);
+                    SoftwareRenderer_cleanup(&fill_software);
+                    return 1;
+                }
+            }
 
-                if (state->selected != MOUSE_SELECTED_NONE) break;
+            char name[64];
+            snprintf(name, sizeof(name), "fill_4k_%s%s", fill_rule_names[rule], t ? "_1_thread" : "");
+            print_benchmark_result(name, "ms/frame", (get_seconds() - start) * 1e3 / fill_frames);
+            print_benchmark_result(name, "record_ms/frame", record_seconds * 1e3 / fill_frames);
+        }
+    }
+    benchmark_sink += fill_software.pixels[(fill_software.height / 2 * fill_software.width + fill_software.width / 2) * 4];
+    free(fill_points);
+    SoftwareRenderer_cleanup(&fill_software);
 
-                // TODO could make the slider container opaque
-                state->selected = MOUSE_SELECTED_BACKGROUND;
+    /* whole frames with the software renderer */
 
-            } break;
+    HeadlessContext context;
+    if (!HeadlessContext_init(&context, INITIAL_SCREEN_WIDTH, INITIAL_SCREEN_HEIGHT)) {
+        HeadlessContext_cleanup(&context);
+        return 1;
+    }
 
-            case SDL_MOUSEBUTTONUP:
-            {
-                state->selected = MOUSE_SELECTED_NONE;
-            } break;
+    for (int c = 0; c < BENCHMARK_CURVES; c++) {
+        if (!CurveDocument_add_curve(&context.state.doc, points[c], weights[c])) {
+            HeadlessContext_cleanup(&context);
+            return 1;
+        }
+    }
 
-            case SDL_MOUSEMOTION:
-            {
-                switch (state->selected) {
-                    case MOUSE_SELECTED_POINT:
-                    {
-                        Vec2 mouse_pos = { e.motion.x, e.motion.y };
-                        state->points[state->selected_index] = view_to_world_pos(
-                            mouse_pos,
-                            state->view_center,
-                            state->view_log_scale,
-                            state->window_width,
-                            state->window_height
-                        );
-                    } break;
+    // the first few frames grow the buffers (including one document copy per snapshot)
+    const int warmup_frames = 4;
+    const int frames = 32;
+    int warm_allocation_count = 0;
+    for (int f = 0; f < warmup_frames + frames; f++) {
+        if (f == warmup_frames) {
+            warm_allocation_count = heap_allocation_count;
+            start = get_seconds();
+        }
 
-                    case MOUSE_SELECTED_SLIDER:
-                    {
+        context.state.dirty = DIRTY_ALL;
+        if (!RenderState_publish(&context.state) || !render(&context.state)) {
+            printf("Failed to render frame\n");
+            HeadlessContext_cleanup(&context);
+            return 1;
+        }
+    }
+    print_benchmark_result("software_frame", "ms/frame", (get_seconds() - start) * 1e3 / frames);
+    // should be 0: steady state frames shouldn't touch the heap
+    print_benchmark_result(
+        "software_frame", "allocations/frame", (double) (heap_allocation_count - warm_allocation_count) / frames
+    );
 
-                        int x1 = state->sliders_x1;
-                        int x2 = state->sliders_x2;
+    HeadlessContext_cleanup(&context);
 
-                        int slider_x = e.motion.x;
-                        if (slider_x < x1) slider_x = x1;
-                        if (slider_x > x2) slider_x = x2;
+    return 0;
+}
 
-                        state->sliders_value[state->selected_index] = slider_x_to_value(slider_x, x1, x2);
-                    } break;
+// B-spline basis function i of the given degree at t, by the Cox-de Boor recursion
+static double cox_de_boor_basis(const double * knots, int i, int degree, double t) {
+    if (t < knots[i] || t >= knots[i + degree + 1]) return 0;
+    if (degree == 0) return 1;
 
-                    case MOUSE_SELECTED_BACKGROUND:
-                    {
-                        Vec2 offset = { e.motion.xrel, e.motion.yrel };
+    double result = 0;
+    if (knots[i + degree] > knots[i]) {
+        result += (t - knots[i]) / (knots[i + degree] - knots[i]) * cox_de_boor_basis(knots, i, degree - 1, t);
+    }
+    if (knots[i + degree + 1] > knots[i + 1]) {
+        result += (knots[i + degree + 1] - t) / (knots[i + degree + 1] - knots[i + 1])
+            * cox_de_boor_basis(knots, i + 1, degree - 1, t);
+    }
+    return result;
+}
 
-                        /* Adjust for scaling */
-                        Vec2 scaled_offset = Vec2_scale(offset, get_actual_scale(state->view_log_scale));
+/* A point on a NURBS curve as the weighted sum of its control points over the basis
+   functions, which shares nothing with de Boor's algorithm. It is kept in double
+   precision, and t has to be below the end of the domain, where every basis function is 0. */
+static void nurbs_reference_point(const NurbsCurve * curve, double t, double * x_out, double * y_out) {
+    double x = 0, y = 0, w = 0;
+    for (int i = 0; i < curve->count; i++) {
+        double basis = cox_de_boor_basis(curve->knots, i, curve->degree, t) * curve->weights[i];
+        x += basis * curve->points[i].x;
+        y += basis * curve->points[i].y;
+        w += basis;
+    }
+    *x_out = x / w;
+    *y_out = y / w;
+}
 
-                        state->view_center = Vec2_sub(state->view_center, scaled_offset);
-                    } break;
+/* Measures how far the float path strays from the double reference, printing one
+   JSON object per comparison. Curves the size of the benchmark ones are placed at
+   increasing distances from the origin, as float error grows with the size of the
+   coordinates, and given weights picked in different ways across the slider range.
+   Errors are in world units, and in units in the last place of the curve's largest
+   coordinate, which carries over to curves of any size.
+
+   NURBS evaluation, single and batched, is then checked against the Cox-de Boor
+   reference, as are the rational cubics that curves up to degree 3 convert into
+   exactly. NURBS errors are in world units, for curves the size of the window, and
+   include rounding the results to float. */
+int run_precision_report(void) {
+    srand(1);
+
+    const char * weight_names[] = { "random", "extremes", "all_min", "all_max", "min_ends", "max_ends" };
+    const int weight_modes = sizeof(weight_names) / sizeof(weight_names[0]);
+    const float offsets[] = { 0, 1e3f, 1e5f };
+    const int offset_count = sizeof(offsets) / sizeof(offsets[0]);
+    const int curves = 256;
+
+    static double ts[BENCHMARK_SAMPLES];
+    static float float_ts[BENCHMARK_SAMPLES];
+    static float xs[BENCHMARK_SAMPLES];
+    static float ys[BENCHMARK_SAMPLES];
+    static Vec2 reference[MAX_CURVE_SEGMENTS + 1];
+    static Vec2 fast[MAX_CURVE_SEGMENTS + 1];
+    for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+        ts[i] = (double) i / (BENCHMARK_SAMPLES - 1);
+        float_ts[i] = ts[i];
+    }
 
-                    default:
-                        assert(state->selected == MOUSE_SELECTED_NONE); // only other option
+    for (int mode = 0; mode < weight_modes; mode++) {
+        for (int o = 0; o < offset_count; o++) {
+            // index 0 is plain evaluation, 1 is tessellation
+            double max_error[2] = {0}, sum_squares[2] = {0}, max_ulps[2] = {0};
+            long long compared[2] = {0};
+
+            for (int c = 0; c < curves; c++) {
+                Vec2 points[4];
+                float weights[4];
+                get_random_curve(INITIAL_SCREEN_HEIGHT, points, weights);
+                float magnitude = 0;
+                for (int i = 0; i < 4; i++) {
+                    points[i] = Vec2_add(points[i], (Vec2) { offsets[o], offsets[o] });
+                    magnitude = fmaxf(magnitude, fmaxf(fabsf(points[i].x), fabsf(points[i].y)));
+
+                    bool inner = i == 1 || i == 2;
+                    switch (mode) {
+                        case 1: weights[i] = rand() % 2 ? SLIDER_MAX : SLIDER_MIN; break;
+                        case 2: weights[i] = SLIDER_MIN; break;
+                        case 3: weights[i] = SLIDER_MAX; break;
+                        case 4: weights[i] = inner ? SLIDER_MAX : SLIDER_MIN; break;
+                        case 5: weights[i] = inner ? SLIDER_MIN : SLIDER_MAX; break;
+                    }
+                }
+                double ulp = nextafterf(magnitude, INFINITY) - magnitude;
+
+                rational_cubic_bezier_batch_float(float_ts, BENCHMARK_SAMPLES, points, weights, xs, ys);
+                for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+                    reference[0] = rational_cubic_bezier(ts[i], points, weights);
+                    fast[0] = (Vec2) { xs[i], ys[i] };
+                    double error = hypot(fast[0].x - reference[0].x, fast[0].y - reference[0].y);
+                    max_error[0] = fmax(max_error[0], error);
+                    max_ulps[0] = fmax(max_ulps[0], error / ulp);
+                    sum_squares[0] += error * error;
+                    compared[0]++;
                 }
-            } break;
 
-            case SDL_MOUSEWHEEL:
-            {
-                int mouse_x, mouse_y;
-                SDL_GetMouseState(&mouse_x, &mouse_y);
-                Vec2 mouse_pos = { mouse_x, mouse_y };
-
-                Vec2 mouse_world_pos = view_to_world_pos(
-                    mouse_pos,
-                    state->view_center,
-                    state->view_log_scale,
-                    state->window_width,
-                    state->window_height
+                int segments = rational_cubic_bezier_segment_count(points, weights, CURVE_TOLERANCE);
+                rational_cubic_bezier_tessellate_span(points, weights, segments, 0, segments, reference);
+                rational_cubic_bezier_tessellate_span_float(points, weights, segments, 0, segments, fast);
+                for (int i = 0; i <= segments; i++) {
+                    double error = hypot(fast[i].x - reference[i].x, fast[i].y - reference[i].y);
+                    max_error[1] = fmax(max_error[1], error);
+                    max_ulps[1] = fmax(max_ulps[1], error / ulp);
+                    sum_squares[1] += error * error;
+                    compared[1]++;
+                }
+            }
+
+            for (int k = 0; k < 2; k++) {
+                printf(
+                    "{\"path\": \"%s\", \"weights\": \"%s\", \"offset\": %g, \"max_error\": %.6g, "
+                    "\"rms_error\": %.6g, \"max_error_ulps\": %.6g}\n",
+                    k == 0 ? "evaluate" : "tessellate",
+                    weight_names[mode],
+                    offsets[o],
+                    max_error[k],
+                    sqrt(sum_squares[k] / compared[k]),
+                    max_ulps[k]
                 );
+            }
+        }
+    }
 
-                float scale_change = -e.wheel.y;
+    const int nurbs_count = 12;
+    const int nurbs_samples = BENCHMARK_SAMPLES;
+    const int nurbs_curves = 64;
+    Vec2 nurbs_points[12];
+    float nurbs_weights[12];
+    double nurbs_knots[12 + NURBS_MAX_DEGREE + 1];
+    static double nurbs_ts[BENCHMARK_SAMPLES];
+    CurveDocument doc;
+    if (!CurveDocument_init(&doc)) return 1;
+
+    for (int degree = 1; degree <= 7; degree++) {
+        // index 0 is evaluation, 1 is batch evaluation and 2 is the converted cubics
+        double max_error[3] = {0};
+
+        for (int c = 0; c < nurbs_curves; c++) {
+            for (int i = 0; i < nurbs_count; i += 4) {
+                get_random_curve(INITIAL_SCREEN_HEIGHT, &nurbs_points[i], &nurbs_weights[i]);
+            }
+            // unclamped knots with gaps of 0 to 3, so some of them are repeated
+            nurbs_knots[0] = 0;
+            for (int i = 1; i < nurbs_count + degree + 1; i++) {
+                nurbs_knots[i] = nurbs_knots[i - 1] + rand() % 4;
+            }
+            NurbsCurve nurbs = { degree, nurbs_count, nurbs_points, nurbs_weights, nurbs_knots };
+            if (!(nurbs_knots[degree] < nurbs_knots[nurbs_count])) continue;
+
+            // the reference can't take the end of the domain
+            const double start = nurbs_knots[degree];
+            const double end = nurbs_knots[nurbs_count];
+            for (int i = 0; i < nurbs_samples; i++) {
+                nurbs_ts[i] = start + (end - start) * i / nurbs_samples;
+            }
 
-                /* Update viewport center coordinates so that coordinate under the
-                   mouse position remains under the mouse position after scaling */
+            NurbsCurve_evaluate_batch(&nurbs, nurbs_ts, nurbs_samples, xs, ys);
+            for (int i = 0; i < nurbs_samples; i++) {
+                double x, y;
+                nurbs_reference_point(&nurbs, nurbs_ts[i], &x, &y);
+                Vec2 single = NurbsCurve_evaluate(&nurbs, nurbs_ts[i]);
+                max_error[0] = fmax(max_error[0], hypot(single.x - x, single.y - y));
+                max_error[1] = fmax(max_error[1], hypot(xs[i] - x, ys[i] - y));
+            }
 
-                state->view_center = Vec2_add(
-                    Vec2_scale(state->view_center, get_actual_scale(scale_change)),
-                    Vec2_scale(mouse_world_pos, 1 - get_actual_scale(scale_change))
+            if (degree > 3) continue;
+
+            // each non-empty span becomes one cubic, over the same stretch of t
+            doc.count = 0;
+            if (!CurveDocument_add_nurbs(&doc, &nurbs, CURVE_TOLERANCE)) {
+                CurveDocument_cleanup(&doc);
+                return 1;
+            }
+            int span = degree;
+            int curve = 0;
+            while (nurbs_knots[span] == nurbs_knots[span + 1]) span++;
+            for (int i = 0; i < nurbs_samples; i++) {
+                while (nurbs_ts[i] >= nurbs_knots[span + 1]) {
+                    span++;
+                    if (nurbs_knots[span] < nurbs_knots[span + 1]) curve++;
+                }
+                double a = nurbs_knots[span];
+                double b = nurbs_knots[span + 1];
+                Vec2 converted = rational_cubic_bezier(
+                    (nurbs_ts[i] - a) / (b - a), CurveDocument_points(&doc, curve), CurveDocument_weights(&doc, curve)
                 );
+                double x, y;
+                nurbs_reference_point(&nurbs, nurbs_ts[i], &x, &y);
+                max_error[2] = fmax(max_error[2], hypot(converted.x - x, converted.y - y));
+            }
+        }
+
+        const char * nurbs_paths[3] = { "nurbs_evaluate", "nurbs_evaluate_batch", "nurbs_convert" };
+        for (int k = 0; k < (degree > 3 ? 2 : 3); k++) {
+            printf(
+                "{\"path\": \"%s\", \"degree\": %d, \"max_error\": %.6g}\n",
+                nurbs_paths[k], degree, max_error[k]
+            );
+        }
+    }
+    CurveDocument_cleanup(&doc);
 
-                state->view_log_scale += scale_change;
+    return 0;
+}
 
-            } break;
+// writes a scene file of count random curves spread out over an area that grows with count
+int generate_scene(const char * path, int count) {
+    if (count <= 0) {
+        printf("Need a positive number of curves to generate\n");
+        return 1;
+    }
 
-            default:
-                assert(0);
+    CurveDocument doc;
+    CurveDocument_init(&doc);
+    if (!CurveDocument_reserve(&doc, count)) {
+        CurveDocument_cleanup(&doc);
+        return 1;
+    }
+
+    srand(1);
+    const float curve_size = 100;
+    const float area_size = curve_size * sqrtf(count);
+    for (int c = 0; c < count; c++) {
+        Vec2 points[4];
+        float weights[4];
+        get_random_curve(curve_size, points, weights);
+
+        Vec2 offset = {
+            area_size * ((float) rand() / RAND_MAX - 0.5f),
+            area_size * ((float) rand() / RAND_MAX - 0.5f),
+        };
+        for (int i = 0; i < 4; i++) {
+            points[i] = Vec2_add(points[i], offset);
+        }
+
+        if (!CurveDocument_add_curve(&doc, points, weights)) {
+            CurveDocument_cleanup(&doc);
+            return 1;
+        }
+    }
+
+    bool success = CurveDocument_save(&doc, path);
+    CurveDocument_cleanup(&doc);
+
+    return success ? 0 : 1;
+}
+
+// how far curves of degree above 3 can end up from the NURBS they were imported from
+const float NURBS_IMPORT_TOLERANCE = 0.01f;
+
+/* Converts a text file of NURBS curves into a scene file. Each curve is written as
+
+       nurbs <degree> <control point count>
+       <x> <y> <weight>              (once per control point)
+       <knot> <knot> ...             (control point count + degree + 1 of them)
+
+   with any whitespace between the numbers. */
+int import_nurbs(const char * input_path, const char * output_path) {
+    FILE * file = fopen(input_path, "r");
+    if (!file) {
+        printf("Could not open %s\n", input_path);
+        return 1;
+    }
+
+    CurveDocument doc;
+    CurveDocument_init(&doc);
+    Vec2 * points = NULL;
+    float * weights = NULL;
+    double * knots = NULL;
+    int points_capacity = 0;
+    int weights_capacity = 0;
+    int knots_capacity = 0;
+
+    bool success = true;
+    int curves = 0;
+    int degree, count;
+    int header_fields;
+    while (success && (header_fields = fscanf(file, " nurbs %d %d", &degree, &count)) == 2) {
+        curves++;
+        if (degree < 1 || degree > NURBS_MAX_DEGREE || count < degree + 1 || count > INT_MAX / 4) {
+            printf("Curve %d of %s has degree %d and %d control points\n", curves, input_path, degree, count);
+            success = false;
+            break;
+        }
+        if (!reserve_buffer((void **) &points, &points_capacity, count, sizeof(Vec2)) ||
+            !reserve_buffer((void **) &weights, &weights_capacity, count, sizeof(float)) ||
+            !reserve_buffer((void **) &knots, &knots_capacity, count + degree + 1, sizeof(double))
+        ) {
+            success = false;
+            break;
+        }
+
+        for (int i = 0; i < count && success; i++) {
+            success = fscanf(file, "%f %f %f", &points[i].x, &points[i].y, &weights[i]) == 3;
+        }
+        for (int i = 0; i < count + degree + 1 && success; i++) {
+            success = fscanf(file, "%lf", &knots[i]) == 1;
+        }
+        if (!success) {
+            printf("Curve %d of %s is cut short\n", curves, input_path);
+            break;
+        }
+
+        NurbsCurve curve = { degree, count, points, weights, knots };
+        if (!CurveDocument_add_nurbs(&doc, &curve, NURBS_IMPORT_TOLERANCE)) {
+            printf("Could not convert curve %d of %s\n", curves, input_path);
+            success = false;
+        }
+    }
+    if (success && header_fields != EOF) {
+        printf("Could not read curve %d of %s\n", curves + 1, input_path);
+        success = false;
+    }
+    if (success && doc.count == 0) {
+        printf("No curves in %s\n", input_path);
+        success = false;
+    }
+    fclose(file);
+    free(points);
+    free(weights);
+    free(knots);
+
+    if (success) {
+        success = CurveDocument_save(&doc, output_path);
+        if (success) printf("Imported %d curves as %d rational cubics\n", curves, doc.count);
+    }
+    CurveDocument_cleanup(&doc);
+
+    return success ? 0 : 1;
+}
+
+/* Replays an input recording with the software renderer, from the given scene (or
+   the default curve), handling each event and drawing at each frame marker like the
+   main loop did. Events are replayed as fast as possible, or at their recorded times
+   if realtime is set. The times of the frames that were drawn are printed at the end
+   as JSON lines, like the benchmarks. */
+int run_replay(const char * recording_path, const char * scene_path, bool realtime) {
+    int result = 1;
+    HeadlessContext context = {0};
+    double * frame_ms = NULL;
+    int frame_count = 0;
+    int frame_capacity = 0;
+
+    FILE * file = fopen(recording_path, "rb");
+    if (!file) {
+        printf("Could not open %s\n", recording_path);
+        return 1;
+    }
+
+    RecordingHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == RECORDING_MAGIC &&
+        header.version == RECORDING_VERSION &&
+        header.width > 0 &&
+        header.height > 0;
+    if (!valid) {
+        printf("%s is not an input recording this version can read\n", recording_path);
+        fclose(file);
+        return 1;
+    }
+
+    // the canvas keeps the starting size, with anything drawn outside it after a resize clipped
+    if (!HeadlessContext_init(&context, header.width, header.height)) {
+        goto replay_cleanup;
+    }
+
+    if (scene_path && !RenderState_load_scene(&context.state, scene_path)) {
+        goto replay_cleanup;
+    }
+    context.state.mouse_x = header.mouse_x;
+    context.state.mouse_y = header.mouse_y;
+
+    const double start = get_seconds();
+    RecordedEvent record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        if (realtime) {
+            double wait = record.time_ms * 1e-3 - (get_seconds() - start);
+            if (wait > 0) SDL_Delay(wait * 1e3);
+        }
+
+        if (record.type != RECORDED_FRAME) {
+            SDL_Event e = RecordedEvent_unpack(&record);
+            handle_window_event(e, &context.state);
+            handle_mouse_event(e, &context.state);
+#ifdef BEZIER_PROFILE
+            handle_key_event(e, &context.state);
+#endif
+            continue;
+        }
+
+        // the same as render() returning straight away, but without timing it
+        if (!RenderState_frame_pending(&context.state)) continue;
+
+        double frame_start = get_seconds();
+        if (!render(&context.state)) {
+            printf("Failed to render frame\n");
+            goto replay_cleanup;
+        }
+        double elapsed_ms = (get_seconds() - frame_start) * 1e3;
+
+        if (!reserve_buffer((void **) &frame_ms, &frame_capacity, frame_count + 1, sizeof(double))) {
+            goto replay_cleanup;
+        }
+        frame_ms[frame_count++] = elapsed_ms;
+    }
+    if (ferror(file)) {
+        printf("Failed to read %s\n", recording_path);
+        goto replay_cleanup;
+    }
+    const double seconds = get_seconds() - start;
+
+    print_benchmark_result("replay", "seconds", seconds);
+    print_benchmark_result("replay", "frames", frame_count);
+    if (frame_count > 0) {
+        double total_ms = 0;
+        for (int i = 0; i < frame_count; i++) total_ms += frame_ms[i];
+        qsort(frame_ms, frame_count, sizeof(double), compare_doubles);
+
+        print_benchmark_result("replay_frame", "ms/frame", total_ms / frame_count);
+        print_benchmark_result("replay_frame_p50", "ms", frame_ms[frame_count / 2]);
+        print_benchmark_result("replay_frame_p90", "ms", frame_ms[frame_count * 9 / 10]);
+        print_benchmark_result("replay_frame_p99", "ms", frame_ms[frame_count * 99 / 100]);
+        print_benchmark_result("replay_frame_max", "ms", frame_ms[frame_count - 1]);
+    }
+    result = 0;
+
+replay_cleanup:
+    free(frame_ms);
+    HeadlessContext_cleanup(&context);
+    fclose(file);
+
+    return result;
+}
+
+/* The window's renderer, and everything drawn with it, belongs to the render thread.
+   SDL renderers have to be used on the thread that made them, so the render thread
+   creates it and sets up the render state with it, then sleeps until a snapshot is
+   published and draws it. The main thread only handles events, so input never waits
+   for a frame to be drawn or presented. */
+typedef struct {
+    RenderState * state;
+    SDL_Window * window;
+    TTF_Font * font;
+    /* a scene file to show instead of the default curve, or NULL */
+    const char * scene_path;
+    SDL_Thread * thread;
+    /* posted once the render state is set up, or couldn't be, as started says */
+    SDL_sem * ready;
+    bool started;
+    /* set under the render state's mutex to have the thread clean up and finish */
+    bool quit;
+} RenderThread;
+
+static int render_thread_main(void * data) {
+    RenderThread * thread = data;
+    RenderState * state = thread->state;
+
+    SDL_Renderer * renderer = SDL_CreateRenderer(thread->window, -1, SDL_RENDERER_ACCELERATED);
+    if (!renderer) {
+        printf("Renderer could not be created: %s\n", SDL_GetError());
+    } else {
+        if (SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND)) {
+            printf("Warning: Renderer blend mode could not be set properly (SDL error: %s)\n", SDL_GetError());
         }
 
+        if (!RenderState_init(state, (Canvas) { renderer, NULL }, thread->font)) {
+            printf("Failed to intialise render state\n");
+        } else {
+            thread->started = !thread->scene_path || RenderState_load_scene(state, thread->scene_path);
+        }
+    }
+    bool started = thread->started;
+    if (SDL_SemPost(thread->ready)) assert(0);
+
+    // after a frame fails to draw, the thread just waits to be told to finish
+    bool failed = false;
+    while (started) {
+        if (SDL_LockMutex(state->mutex)) assert(0);
+        while (!thread->quit && (failed || !RenderState_frame_pending(state))) {
+            if (SDL_CondWait(state->published, state->mutex)) assert(0);
+        }
+        bool quit = thread->quit;
         if (SDL_UnlockMutex(state->mutex)) assert(0);
+        if (quit) break;
+
+        if (!render(state)) {
+            printf("Failed to render frame\n");
+            failed = true;
+            SDL_Event e = {0};
+            e.type = SDL_QUIT;
+            SDL_PushEvent(&e);
+        }
+    }
+
+    // the atlas and fill textures go along with the renderer, on this thread
+    RenderState_cleanup(state);
+    if (renderer) SDL_DestroyRenderer(renderer);
+    return 0;
+}
+
+/* Starts the render thread and waits for it to set up the render state. Returns
+   false, with the thread finished, if it couldn't. */
+bool RenderThread_start(RenderThread * thread) {
+    thread->ready = SDL_CreateSemaphore(0);
+    if (!thread->ready) {
+        printf("Could not create semaphore: %s\n", SDL_GetError());
+        return false;
+    }
+
+    thread->thread = SDL_CreateThread(render_thread_main, "render", thread);
+    if (!thread->thread) {
+        printf("Could not create render thread: %s\n", SDL_GetError());
+    } else if (SDL_SemWait(thread->ready)) {
+        assert(0);
+    } else if (!thread->started) {
+        SDL_WaitThread(thread->thread, NULL);
+        thread->thread = NULL;
     }
+
+    SDL_DestroySemaphore(thread->ready);
+    thread->ready = NULL;
+    return thread->started;
+}
+
+// has the render thread clean up the render state and finish, if it is running
+void RenderThread_stop(RenderThread * thread) {
+    if (!thread->thread) return;
+
+    RenderState * state = thread->state;
+    if (SDL_LockMutex(state->mutex)) assert(0);
+    thread->quit = true;
+    if (SDL_CondSignal(state->published)) assert(0);
+    if (SDL_UnlockMutex(state->mutex)) assert(0);
+
+    SDL_WaitThread(thread->thread, NULL);
+    thread->thread = NULL;
 }
 
 int main(int argc, char * argv[]) {
+    select_bezier_batch_kernels();
+
+    // "--precision float" ahead of any other arguments tessellates on the float path
+    if (argc >= 3 && strcmp(argv[1], "--precision") == 0) {
+        if (strcmp(argv[2], "float") == 0) {
+            tessellation_precision = BEZIER_PRECISION_FLOAT;
+        } else if (strcmp(argv[2], "double") != 0) {
+            printf("Unknown precision %s, expected float or double\n", argv[2]);
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
+    // "--fill nonzero" or "--fill evenodd" likewise fills in the curves
+    if (argc >= 3 && strcmp(argv[1], "--fill") == 0) {
+        if (strcmp(argv[2], "evenodd") == 0) {
+            curve_fill_rule = FILL_EVEN_ODD;
+        } else if (strcmp(argv[2], "nonzero") != 0) {
+            printf("Unknown fill rule %s, expected nonzero or evenodd\n", argv[2]);
+            return 1;
+        }
+        fill_curves = true;
+        argc -= 2;
+        argv += 2;
+    }
+
+#ifdef BEZIER_PROFILE
+    // "--trace path" likewise sets where F4 writes the trace
+    if (argc >= 3 && strcmp(argv[1], "--trace") == 0) {
+        profile_trace_path = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+#endif
+
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--headless") == 0) {
+        return render_headless(argv[2], argc == 4 ? argv[3] : NULL);
+    }
+    if (argc == 4 && strcmp(argv[1], "--generate-scene") == 0) {
+        return generate_scene(argv[2], atoi(argv[3]));
+    }
+    if (argc == 4 && strcmp(argv[1], "--import-nurbs") == 0) {
+        return import_nurbs(argv[2], argv[3]);
+    }
+    if (argc == 2 && strcmp(argv[1], "--bench") == 0) {
+        return run_benchmarks();
+    }
+    if (argc == 2 && strcmp(argv[1], "--precision-report") == 0) {
+        return run_precision_report();
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--replay") == 0) {
+        return run_replay(argv[2], argc == 4 ? argv[3] : NULL, false);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--replay-realtime") == 0) {
+        return run_replay(argv[2], argc == 4 ? argv[3] : NULL, true);
+    }
+
+    // "--record path" ahead of an optional scene file records the session's input
+    const char * record_path = NULL;
+    if (argc >= 3 && strcmp(argv[1], "--record") == 0) {
+        record_path = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
     SDL_Window * window = NULL;
-    SDL_Renderer * renderer = NULL;
     TTF_Font * font = NULL;
 
     // initialise SDL
@@ -574,26 +7036,14 @@ int main(int argc, char * argv[]) {
         goto main_cleanup;
     }
 
-    // create renderer
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
-        printf("Renderer could not be created: %s\n", SDL_GetError());
-        goto main_cleanup;
-    }
-
-    if (SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND)) {
-        printf("Warning: Renderer blend mode could not be set properly (SDL error: %s)\n", SDL_GetError());
-    }
-
     if (TTF_Init()) {
         printf("SDL_ttf could not initialize: %s\n", TTF_GetError());
         goto main_cleanup;
     }
 
-    const char font_path[] = "fonts/m5x7.ttf";
-    font = TTF_OpenFont(font_path, 16); // ptsize = 16, 32, 48, etc.
+    font = TTF_OpenFont(FONT_PATH, FONT_SIZE);
     if (!font) {
-        printf("Could not open font at path %s: %s\n", font_path, TTF_GetError());
+        printf("Could not open font at path %s: %s\n", FONT_PATH, TTF_GetError());
         goto main_cleanup;
     }
 
@@ -601,10 +7051,20 @@ int main(int argc, char * argv[]) {
         bool quit = false;
         SDL_Event e;
 
-        // initialise render state
+        // the render thread makes the renderer and the render state, and draws with them
         RenderState state = {0};
-        if (!RenderState_init(&state, renderer, font)) {
-            printf("Failed to intialise render state\n");
+        RenderThread render_thread = { &state, window, font, argc == 2 ? argv[1] : NULL };
+        InputRecorder recorder = {0};
+        if (!RenderThread_start(&render_thread)) {
+            goto main_render_cleanup;
+        }
+
+        // wheel zooming is centred on the mouse, which may not have moved yet
+        SDL_GetMouseState(&state.mouse_x, &state.mouse_y);
+
+        if (record_path && !InputRecorder_open(
+            &recorder, record_path, state.view.width, state.view.height, state.mouse_x, state.mouse_y
+        )) {
             goto main_render_cleanup;
         }
 
@@ -613,27 +7073,38 @@ int main(int argc, char * argv[]) {
         SDL_AddEventWatch(handle_window_event_helper, &state);
 
         while (!quit) {
-            while (SDL_PollEvent(&e)) {
+            // sleep until something happens, then handle everything queued up
+            if (!SDL_WaitEvent(&e)) {
+                printf("Failed to wait for events: %s\n", SDL_GetError());
+                goto main_render_cleanup;
+            }
+            do {
                 if (e.type == SDL_QUIT) quit = true;
+                if (recorder.file && !InputRecorder_add_event(&recorder, &e)) {
+                    goto main_render_cleanup;
+                }
                 handle_mouse_event(e, &state);
-            }
+#ifdef BEZIER_PROFILE
+                handle_key_event(e, &state);
+#endif
+            } while (SDL_PollEvent(&e));
 
-            if (!render(&state)) {
-                printf("Failed to render frame\n");
+            // the render thread draws whatever was published, which a replay draws here
+            if (recorder.file && !InputRecorder_add_frame(&recorder)) {
                 goto main_render_cleanup;
             }
-            SDL_Delay(5);
         }
 
 main_render_cleanup:
-        RenderState_cleanup(&state);
+        if (recorder.file) InputRecorder_close(&recorder);
+        SDL_DelEventWatch(handle_window_event_helper, &state);
+        RenderThread_stop(&render_thread);
     }
 
 
 main_cleanup:
     // TODO destroy font texture
     TTF_CloseFont(font);
-    SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
 
     TTF_Quit();